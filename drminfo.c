@@ -22,6 +22,8 @@
 #include "drm-lease.h"
 #include "logind.h"
 #include "complete.h"
+#include "json.h"
+#include "edid.h"
 
 static int ttycols = 80;
 
@@ -39,6 +41,14 @@ static void drm_list_properties(int fd, uint32_t id, uint32_t objtype)
        if (prop->count_values) {
            fprintf(stdout, "    property: %s, value %" PRId64 "\n",
                    prop->name, props->prop_values[i]);
+       } else if (drm_property_type_is(prop, DRM_MODE_PROP_BLOB)) {
+           drmModePropertyBlobPtr blob = props->prop_values[i]
+               ? drmModeGetPropertyBlob(fd, props->prop_values[i]) : NULL;
+           fprintf(stdout, "    property: %s, blob #%" PRId64 ", %d bytes\n",
+                   prop->name, props->prop_values[i],
+                   blob ? blob->length : 0);
+           if (blob)
+               drmModeFreePropertyBlob(blob);
        } else {
            fprintf(stdout, "    property: %s\n", prop->name);
        }
@@ -58,8 +68,152 @@ drm_get_property_blob(int fd, uint32_t id, uint32_t objtype, const char *name)
    return drmModeGetPropertyBlob(fd, blob_id);
 }
 
+/* ------------------------------------------------------------------ */
+/* edid                                                               */
+
+struct drm_edid {
+    uint64_t          blob_id;
+    uint64_t          hash;
+    uint32_t          length;
+    uint8_t           *data;
+    struct edid_info  *info;
+    bool              valid;
+    struct drm_edid   *next;
+};
+
+static struct drm_edid *drm_edid_cache;
+
+static uint64_t drm_edid_hash(const uint8_t *data, size_t len)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL; /* fnv-1a */
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/*
+ * Blob ids stay the same as long as the kernel doesn't get a new edid
+ * from the monitor, so a blob id hit avoids the fetch altogether.
+ * Different blob ids with identical contents (hotplug, multiple
+ * outputs with the same monitor model) share the decoded info.
+ * Both the edid dump and the EDID connector property go through here,
+ * so each blob is fetched from the kernel only once.
+ */
+static struct drm_edid *drm_edid_by_blob(int fd, uint64_t blob_id)
+{
+    drmModePropertyBlobRes *blob;
+    struct drm_edid *e, *same = NULL;
+    uint64_t hash;
+
+    if (!blob_id)
+        return NULL;
+    for (e = drm_edid_cache; e; e = e->next)
+        if (e->blob_id == blob_id)
+            return e;
+
+    blob = drmModeGetPropertyBlob(fd, blob_id);
+    if (!blob)
+        return NULL;
+    hash = drm_edid_hash(blob->data, blob->length);
+    for (e = drm_edid_cache; e; e = e->next) {
+        if (e->hash == hash && e->length == blob->length &&
+            memcmp(e->data, blob->data, blob->length) == 0) {
+            same = e;
+            break;
+        }
+    }
+
+    e = calloc(1, sizeof(*e));
+    e->blob_id = blob_id;
+    e->hash    = hash;
+    e->length  = blob->length;
+    if (same) {
+        e->data  = same->data;
+        e->info  = same->info;
+        e->valid = same->valid;
+    } else {
+        e->data = malloc(blob->length);
+        memcpy(e->data, blob->data, blob->length);
+        e->info = malloc(sizeof(*e->info));
+        e->valid = edid_parse(e->info, e->data, e->length) == 0;
+    }
+    drmModeFreePropertyBlob(blob);
+
+    e->next = drm_edid_cache;
+    drm_edid_cache = e;
+    return e;
+}
+
+static struct drm_edid *drm_get_edid(int fd, uint32_t conn_id)
+{
+    uint64_t blob_id;
+
+    blob_id = drm_get_property_value(fd, conn_id, DRM_MODE_OBJECT_CONNECTOR,
+                                     "EDID");
+    return drm_edid_by_blob(fd, blob_id);
+}
+
+static void drm_print_edid_mode(struct edid_mode *m)
+{
+    drmModeModeInfo *mode = &m->mode;
+
+    fprintf(stdout, "    edid mode: %dx%d%s@%d",
+            mode->hdisplay, mode->vdisplay,
+            (mode->flags & DRM_MODE_FLAG_INTERLACE) ? "i" : "",
+            mode->vrefresh);
+    if (mode->clock)
+        fprintf(stdout, ", %d.%02d MHz, %d/%d total",
+                mode->clock / 1000, (mode->clock % 1000) / 10,
+                mode->htotal, mode->vtotal);
+    if (m->vic)
+        fprintf(stdout, ", vic %d", m->vic);
+    fprintf(stdout, " (%s%s)\n", m->source,
+            m->preferred ? ", preferred" : "");
+}
+
+static void drm_info_edid(int fd, drmModeConnector *conn)
+{
+    struct drm_edid *e = drm_get_edid(fd, conn->connector_id);
+    struct edid_info *info;
+    int m;
+
+    if (!e)
+        return;
+    if (!e->valid) {
+        fprintf(stdout, "    edid: invalid (%d bytes)\n", e->length);
+        return;
+    }
+    info = e->info;
+    fprintf(stdout, "    edid: %s, product 0x%04x, serial %u",
+            info->vendor, info->product, info->serial);
+    if (info->name[0])
+        fprintf(stdout, ", \"%s\"", info->name);
+    fprintf(stdout, "\n");
+    fprintf(stdout, "    edid: version %d.%d, week %d/%d, %dx%d cm, %d ext\n",
+            info->version, info->revision, info->week, info->year,
+            info->width_cm, info->height_cm, info->extensions);
+    if (info->has_range)
+        fprintf(stdout, "    edid: range %d-%d Hz, %d-%d kHz, %d MHz\n",
+                info->min_vfreq, info->max_vfreq,
+                info->min_hfreq, info->max_hfreq, info->max_clock);
+    if (info->has_cea)
+        fprintf(stdout, "    edid: cea-861 rev %d%s%s%s%s%s\n",
+                info->cea_revision,
+                info->cea_hdmi      ? ", hdmi"      : "",
+                info->cea_audio     ? ", audio"     : "",
+                info->cea_underscan ? ", underscan" : "",
+                info->cea_ycbcr444  ? ", ycbcr444"  : "",
+                info->cea_ycbcr422  ? ", ycbcr422"  : "");
+    for (m = 0; m < info->count_modes; m++)
+        drm_print_edid_mode(info->modes + m);
+}
+
 static void drm_info_conn(int fd, drmModeConnector *conn,
-                          bool print_properties)
+                          bool print_properties, bool print_edid)
 {
     drmModeEncoder *enc;
     drmModeCrtc *crtc;
@@ -119,9 +273,12 @@ static void drm_info_conn(int fd, drmModeConnector *conn,
             c = 1;
         };
     }
+
+    if (print_edid)
+        drm_info_edid(fd, conn);
 }
 
-static void drm_info_conns(int fd, bool print_properties)
+static void drm_info_conns(int fd, bool print_properties, bool print_edid)
 {
     drmModeConnector *conn;
     drmModeRes *res;
@@ -138,7 +295,7 @@ static void drm_info_conns(int fd, bool print_properties)
         if (!conn)
             continue;
 
-        drm_info_conn(fd, conn, print_properties);
+        drm_info_conn(fd, conn, print_properties, print_edid);
         drmModeFreeConnector(conn);
         fprintf(stdout, "\n");
     }
@@ -369,43 +526,45 @@ static void drm_info_misc(int fd)
     busid = drmGetBusid(fd);
     if (busid) {
         fprintf(stdout, "busid   : \"%s\"\n", busid);
+        drmFreeBusid(busid);
     }
 
     fprintf(stdout, "\n");
 }
 
-static void drm_info_caps(int fd)
-{
-    static const char *caps[] = {
-        [ DRM_CAP_DUMB_BUFFER          ] = "DUMB_BUFFER",
-        [ DRM_CAP_VBLANK_HIGH_CRTC     ] = "VBLANK_HIGH_CRTC",
-        [ DRM_CAP_DUMB_PREFERRED_DEPTH ] = "DUMB_PREFERRED_DEPTH",
-        [ DRM_CAP_DUMB_PREFER_SHADOW   ] = "DUMB_PREFER_SHADOW",
-        [ DRM_CAP_PRIME                ] = "PRIME",
-        [ DRM_CAP_TIMESTAMP_MONOTONIC  ] = "TIMESTAMP_MONOTONIC",
-        [ DRM_CAP_ASYNC_PAGE_FLIP      ] = "ASYNC_PAGE_FLIP",
-        [ DRM_CAP_CURSOR_WIDTH         ] = "CURSOR_WIDTH",
-        [ DRM_CAP_CURSOR_HEIGHT        ] = "CURSOR_HEIGHT",
-        [ DRM_CAP_ADDFB2_MODIFIERS     ] = "ADDFB2_MODIFIERS",
-        [ DRM_CAP_PAGE_FLIP_TARGET     ] = "PAGE_FLIP_TARGET",
-        [ DRM_CAP_CRTC_IN_VBLANK_EVENT ] = "CRTC_IN_VBLANK_EVENT",
-        [ DRM_CAP_SYNCOBJ              ] = "SYNCOBJ",
+static const char *drm_caps[] = {
+    [ DRM_CAP_DUMB_BUFFER          ] = "DUMB_BUFFER",
+    [ DRM_CAP_VBLANK_HIGH_CRTC     ] = "VBLANK_HIGH_CRTC",
+    [ DRM_CAP_DUMB_PREFERRED_DEPTH ] = "DUMB_PREFERRED_DEPTH",
+    [ DRM_CAP_DUMB_PREFER_SHADOW   ] = "DUMB_PREFER_SHADOW",
+    [ DRM_CAP_PRIME                ] = "PRIME",
+    [ DRM_CAP_TIMESTAMP_MONOTONIC  ] = "TIMESTAMP_MONOTONIC",
+    [ DRM_CAP_ASYNC_PAGE_FLIP      ] = "ASYNC_PAGE_FLIP",
+    [ DRM_CAP_CURSOR_WIDTH         ] = "CURSOR_WIDTH",
+    [ DRM_CAP_CURSOR_HEIGHT        ] = "CURSOR_HEIGHT",
+    [ DRM_CAP_ADDFB2_MODIFIERS     ] = "ADDFB2_MODIFIERS",
+    [ DRM_CAP_PAGE_FLIP_TARGET     ] = "PAGE_FLIP_TARGET",
+    [ DRM_CAP_CRTC_IN_VBLANK_EVENT ] = "CRTC_IN_VBLANK_EVENT",
+    [ DRM_CAP_SYNCOBJ              ] = "SYNCOBJ",
 #ifdef DRM_CAP_SYNCOBJ_TIMELINE
-        [ DRM_CAP_SYNCOBJ_TIMELINE     ] = "SYNCOBJ_TIMELINE",
+    [ DRM_CAP_SYNCOBJ_TIMELINE     ] = "SYNCOBJ_TIMELINE",
 #endif
-    };
+};
+
+static void drm_info_caps(int fd)
+{
     uint64_t value;
     int i, rc;
 
     fprintf(stdout, "capabilities\n");
-    for (i = 0; i < sizeof(caps)/sizeof(caps[0]); i++) {
-        if (!caps[i])
+    for (i = 0; i < sizeof(drm_caps)/sizeof(drm_caps[0]); i++) {
+        if (!drm_caps[i])
             continue;
         value = 0;
         rc = drmGetCap(fd, i, &value);
         if (rc < 0)
             continue;
-        fprintf(stdout, "    %-22s: %3" PRId64, caps[i], value);
+        fprintf(stdout, "    %-22s: %3" PRId64, drm_caps[i], value);
         switch (i) {
         case DRM_CAP_PRIME:
             if (value) {
@@ -435,6 +594,473 @@ static void list_formats(FILE *fp)
     fprintf(stdout, "\n");
 }
 
+/* ------------------------------------------------------------------ */
+/* json snapshot                                                      */
+
+static void drm_json_fourcc(const char *key, uint32_t fourcc)
+{
+    char name[5] = {
+        (fourcc >>  0) & 0xff,
+        (fourcc >>  8) & 0xff,
+        (fourcc >> 16) & 0xff,
+        (fourcc >> 24) & 0xff,
+        0
+    };
+
+    json_string(key, name);
+}
+
+static void drm_json_property(int fd, drmModePropertyPtr prop, uint64_t value)
+{
+    drmModePropertyBlobPtr blob;
+    struct drm_edid *e;
+    int i;
+
+    json_object_start(prop->name);
+    json_bool("immutable", prop->flags & DRM_MODE_PROP_IMMUTABLE);
+    json_bool("atomic", prop->flags & DRM_MODE_PROP_ATOMIC);
+
+    if (drm_property_type_is(prop, DRM_MODE_PROP_SIGNED_RANGE)) {
+        json_string("type", "signed range");
+        json_int("value", (int64_t)value);
+        if (prop->count_values == 2) {
+            json_int("min", (int64_t)prop->values[0]);
+            json_int("max", (int64_t)prop->values[1]);
+        }
+    } else if (drm_property_type_is(prop, DRM_MODE_PROP_RANGE)) {
+        json_string("type", "range");
+        json_uint("value", value);
+        if (prop->count_values == 2) {
+            json_uint("min", prop->values[0]);
+            json_uint("max", prop->values[1]);
+        }
+    } else if (drm_property_type_is(prop, DRM_MODE_PROP_ENUM)) {
+        json_string("type", "enum");
+        for (i = 0; i < prop->count_enums; i++)
+            if (prop->enums[i].value == value)
+                json_string("value", prop->enums[i].name);
+        json_array_start("enums");
+        for (i = 0; i < prop->count_enums; i++)
+            json_string(NULL, prop->enums[i].name);
+        json_array_end();
+    } else if (drm_property_type_is(prop, DRM_MODE_PROP_BITMASK)) {
+        json_string("type", "bitmask");
+        json_array_start("value");
+        for (i = 0; i < prop->count_enums; i++)
+            if (value & (1ULL << prop->enums[i].value))
+                json_string(NULL, prop->enums[i].name);
+        json_array_end();
+        json_array_start("bits");
+        for (i = 0; i < prop->count_enums; i++)
+            json_string(NULL, prop->enums[i].name);
+        json_array_end();
+    } else if (drm_property_type_is(prop, DRM_MODE_PROP_BLOB)) {
+        /* blob ids are not stable, only the contents are */
+        json_string("type", "blob");
+        e = strcmp(prop->name, "EDID") == 0
+            ? drm_edid_by_blob(fd, value) : NULL;
+        blob = value && !e ? drmModeGetPropertyBlob(fd, value) : NULL;
+        if (e) {
+            json_hex("value", e->data, e->length);
+        } else if (blob) {
+            json_hex("value", blob->data, blob->length);
+            drmModeFreePropertyBlob(blob);
+        } else {
+            json_string("value", "");
+        }
+    } else if (drm_property_type_is(prop, DRM_MODE_PROP_OBJECT)) {
+        /* object ids are not stable either, only note whether it is set */
+        json_string("type", "object");
+        json_bool("value", value != 0);
+    } else {
+        json_string("type", "unknown");
+        json_uint("value", value);
+    }
+    json_object_end();
+}
+
+static void drm_json_properties(int fd, uint32_t id, uint32_t objtype)
+{
+    drmModeObjectProperties *props;
+    drmModePropertyPtr prop;
+    uint32_t i;
+
+    json_object_start("properties");
+    props = drmModeObjectGetProperties(fd, id, objtype);
+    for (i = 0; props && i < props->count_props; i++) {
+        prop = drmModeGetProperty(fd, props->props[i]);
+        if (!prop)
+            continue;
+        drm_json_property(fd, prop, props->prop_values[i]);
+        drmModeFreeProperty(prop);
+    }
+    drmModeFreeObjectProperties(props);
+    json_object_end();
+}
+
+static void drm_json_mode(const char *key, drmModeModeInfo *mode)
+{
+    json_object_start(key);
+    json_string("name", mode->name);
+    json_uint("clock", mode->clock);
+    json_uint("hdisplay", mode->hdisplay);
+    json_uint("hsync_start", mode->hsync_start);
+    json_uint("hsync_end", mode->hsync_end);
+    json_uint("htotal", mode->htotal);
+    json_uint("hskew", mode->hskew);
+    json_uint("vdisplay", mode->vdisplay);
+    json_uint("vsync_start", mode->vsync_start);
+    json_uint("vsync_end", mode->vsync_end);
+    json_uint("vtotal", mode->vtotal);
+    json_uint("vscan", mode->vscan);
+    json_uint("vrefresh", mode->vrefresh);
+    json_uint("flags", mode->flags);
+    json_uint("type", mode->type);
+    json_object_end();
+}
+
+static void drm_json_edid(int fd, drmModeConnector *conn)
+{
+    struct drm_edid *e = drm_get_edid(fd, conn->connector_id);
+    struct edid_info *info;
+    int m;
+
+    if (!e || !e->valid)
+        return;
+    info = e->info;
+    json_object_start("edid");
+    json_string("vendor", info->vendor);
+    json_uint("product", info->product);
+    json_uint("serial", info->serial);
+    json_string("name", info->name);
+    json_string("serial_string", info->serial_str);
+    json_uint("week", info->week);
+    json_uint("year", info->year);
+    json_uint("version", info->version);
+    json_uint("revision", info->revision);
+    json_uint("width_cm", info->width_cm);
+    json_uint("height_cm", info->height_cm);
+    json_uint("extensions", info->extensions);
+    if (info->has_range) {
+        json_object_start("range");
+        json_uint("min_vfreq", info->min_vfreq);
+        json_uint("max_vfreq", info->max_vfreq);
+        json_uint("min_hfreq", info->min_hfreq);
+        json_uint("max_hfreq", info->max_hfreq);
+        json_uint("max_clock", info->max_clock);
+        json_object_end();
+    }
+    if (info->has_cea) {
+        json_object_start("cea");
+        json_uint("revision", info->cea_revision);
+        json_bool("hdmi", info->cea_hdmi);
+        json_bool("audio", info->cea_audio);
+        json_bool("underscan", info->cea_underscan);
+        json_bool("ycbcr444", info->cea_ycbcr444);
+        json_bool("ycbcr422", info->cea_ycbcr422);
+        json_object_end();
+    }
+    json_array_start("modes");
+    for (m = 0; m < info->count_modes; m++) {
+        json_object_start(NULL);
+        json_string("source", info->modes[m].source);
+        json_uint("vic", info->modes[m].vic);
+        json_bool("preferred", info->modes[m].preferred);
+        drm_json_mode("mode", &info->modes[m].mode);
+        json_object_end();
+    }
+    json_array_end();
+    json_object_end();
+}
+
+/*
+ * Kernel object ids depend on probe order and on what else was created
+ * since boot, so refer to encoders and crtcs by their resource index.
+ */
+static void drm_json_index(const char *key, const uint32_t *ids, int count,
+                           uint32_t id)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (ids[i] == id) {
+            json_uint(key, i);
+            return;
+        }
+    }
+}
+
+static void drm_json_conns(int fd, drmModeRes *res)
+{
+    drmModeConnector *conn;
+    char name[64];
+    int i, j;
+
+    json_object_start("connectors");
+    for (i = 0; i < res->count_connectors; i++) {
+        conn = drmModeGetConnector(fd, res->connectors[i]);
+        if (!conn)
+            continue;
+        drm_conn_name(conn, name, sizeof(name));
+        json_object_start(name);
+        json_string("type", drm_connector_type_name(conn->connector_type));
+        json_string("status", drm_connector_mode_name(conn->connection));
+        json_uint("mm_width", conn->mmWidth);
+        json_uint("mm_height", conn->mmHeight);
+        drm_json_index("encoder", res->encoders, res->count_encoders,
+                       conn->encoder_id);
+        json_array_start("encoders");
+        for (j = 0; j < conn->count_encoders; j++)
+            drm_json_index(NULL, res->encoders, res->count_encoders,
+                           conn->encoders[j]);
+        json_array_end();
+        json_array_start("modes");
+        for (j = 0; j < conn->count_modes; j++)
+            drm_json_mode(NULL, &conn->modes[j]);
+        json_array_end();
+        drm_json_edid(fd, conn);
+        drm_json_properties(fd, conn->connector_id,
+                            DRM_MODE_OBJECT_CONNECTOR);
+        json_object_end();
+        drmModeFreeConnector(conn);
+    }
+    json_object_end();
+}
+
+static void drm_json_encoders(int fd, drmModeRes *res)
+{
+    drmModeEncoder *enc;
+    char id[16];
+    int i;
+
+    json_object_start("encoders");
+    for (i = 0; i < res->count_encoders; i++) {
+        enc = drmModeGetEncoder(fd, res->encoders[i]);
+        if (!enc)
+            continue;
+        snprintf(id, sizeof(id), "%d", i);
+        json_object_start(id);
+        json_string("type", drm_encoder_type_name(enc->encoder_type));
+        drm_json_index("crtc", res->crtcs, res->count_crtcs, enc->crtc_id);
+        json_uint("possible_crtcs", enc->possible_crtcs);
+        json_uint("possible_clones", enc->possible_clones);
+        json_object_end();
+        drmModeFreeEncoder(enc);
+    }
+    json_object_end();
+}
+
+static void drm_json_crtcs(int fd, drmModeRes *res)
+{
+    drmModeCrtc *crtc;
+    char id[16];
+    int i;
+
+    json_object_start("crtcs");
+    for (i = 0; i < res->count_crtcs; i++) {
+        crtc = drmModeGetCrtc(fd, res->crtcs[i]);
+        if (!crtc)
+            continue;
+        snprintf(id, sizeof(id), "%d", i);
+        json_object_start(id);
+        json_bool("fb", crtc->buffer_id != 0);
+        json_uint("x", crtc->x);
+        json_uint("y", crtc->y);
+        json_uint("width", crtc->width);
+        json_uint("height", crtc->height);
+        json_uint("gamma_size", crtc->gamma_size);
+        if (crtc->mode_valid)
+            drm_json_mode("mode", &crtc->mode);
+        drm_json_properties(fd, crtc->crtc_id, DRM_MODE_OBJECT_CRTC);
+        json_object_end();
+        drmModeFreeCrtc(crtc);
+    }
+    json_object_end();
+}
+
+static void drm_json_plane_formats(int fd, drmModePlane *plane)
+{
+    drmModePropertyBlobRes *blob;
+    struct drm_format_modifier_blob *fmb = NULL;
+    struct drm_format_modifier *mods = NULL;
+    uint32_t *formats;
+    char name[5], hex[20];
+    const char *mname;
+    uint32_t i, m;
+
+    blob = drm_get_property_blob(fd, plane->plane_id, DRM_MODE_OBJECT_PLANE,
+                                 "IN_FORMATS");
+    if (blob) {
+        fmb = blob->data;
+        mods = (void*)((char*)fmb + fmb->modifiers_offset);
+    }
+
+    json_object_start("formats");
+    for (i = 0; i < plane->count_formats; i++) {
+        snprintf(name, sizeof(name), "%c%c%c%c",
+                 (plane->formats[i] >>  0) & 0xff,
+                 (plane->formats[i] >>  8) & 0xff,
+                 (plane->formats[i] >> 16) & 0xff,
+                 (plane->formats[i] >> 24) & 0xff);
+        json_array_start(name);
+        if (fmb) {
+            /* IN_FORMATS has its own format list, match by fourcc */
+            formats = (void*)((char*)fmb + fmb->formats_offset);
+            for (m = 0; m < fmb->count_modifiers; m++) {
+                uint32_t idx;
+                for (idx = 0; idx < fmb->count_formats; idx++)
+                    if (formats[idx] == plane->formats[i])
+                        break;
+                if (idx == fmb->count_formats ||
+                    idx < mods[m].offset || idx > mods[m].offset + 63 ||
+                    !(mods[m].formats & (1ULL << (idx - mods[m].offset))))
+                    continue;
+                mname = drm_info_modifier_string(mods[m].modifier);
+                if (strcmp(mname, "unknown") == 0) {
+                    snprintf(hex, sizeof(hex), "0x%016" PRIx64,
+                             (uint64_t)mods[m].modifier);
+                    mname = hex;
+                }
+                json_string(NULL, mname);
+            }
+        }
+        json_array_end();
+    }
+    json_object_end();
+
+    if (blob)
+        drmModeFreePropertyBlob(blob);
+}
+
+static void drm_json_planes(int fd, drmModeRes *res)
+{
+    drmModePlaneRes *pres;
+    drmModePlane *plane;
+    uint64_t type;
+    char id[16];
+    int i;
+
+    drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+    pres = drmModeGetPlaneResources(fd);
+    json_object_start("planes");
+    for (i = 0; pres && i < pres->count_planes; i++) {
+        plane = drmModeGetPlane(fd, pres->planes[i]);
+        if (!plane)
+            continue;
+        type = drm_get_property_value(fd, plane->plane_id,
+                                      DRM_MODE_OBJECT_PLANE, "type");
+        snprintf(id, sizeof(id), "%d", i);
+        json_object_start(id);
+        json_string("type", drm_info_plane_type_string(type));
+        drm_json_index("crtc", res->crtcs, res->count_crtcs, plane->crtc_id);
+        json_bool("fb", plane->fb_id != 0);
+        json_uint("possible_crtcs", plane->possible_crtcs);
+        json_uint("gamma_size", plane->gamma_size);
+        drm_json_plane_formats(fd, plane);
+        drm_json_properties(fd, plane->plane_id, DRM_MODE_OBJECT_PLANE);
+        json_object_end();
+        drmModeFreePlane(plane);
+    }
+    json_object_end();
+    drmModeFreePlaneResources(pres);
+}
+
+static void drm_json_fbformats(int fd)
+{
+    int i;
+
+    drm_plane_init(fd);
+    json_object_start("framebuffer_formats");
+    for (i = 0; i < fmtcnt; i++) {
+        if (!drm_probe_format_fb(fd, &fmts[i]))
+            continue;
+        json_object_start(fmts[i].name);
+        if (fmts[i].fourcc)
+            drm_json_fourcc("fourcc", fmts[i].fourcc);
+        else
+            json_uint("depth", fmts[i].depth);
+        json_uint("bpp", fmts[i].bpp);
+        json_bool("primary", drm_probe_format_primary(&fmts[i]));
+        json_bool("overlay", drm_probe_format_overlay(&fmts[i]));
+        json_bool("cursor", drm_probe_format_cursor(&fmts[i]));
+        json_object_end();
+    }
+    json_object_end();
+}
+
+static void drm_info_json(int fd)
+{
+    drmModeRes *res;
+    uint64_t value;
+    char *busid;
+    int i;
+
+    version = drmGetVersion(fd);
+    res = drmModeGetResources(fd);
+    if (res == NULL) {
+        fprintf(stderr, "drmModeGetResources() failed\n");
+        exit(1);
+    }
+
+    json_start(stdout);
+    json_object_start(NULL);
+
+    json_object_start("driver");
+    json_string("name", version->name);
+    json_string("desc", version->desc);
+    json_string("date", version->date);
+    json_int("major", version->version_major);
+    json_int("minor", version->version_minor);
+    json_int("patchlevel", version->version_patchlevel);
+    busid = drmGetBusid(fd);
+    if (busid) {
+        json_string("busid", busid);
+        drmFreeBusid(busid);
+    }
+    json_object_end();
+
+    json_object_start("caps");
+    for (i = 0; i < sizeof(drm_caps)/sizeof(drm_caps[0]); i++) {
+        if (!drm_caps[i])
+            continue;
+        value = 0;
+        if (drmGetCap(fd, i, &value) < 0)
+            continue;
+        json_uint(drm_caps[i], value);
+    }
+    json_object_end();
+
+    json_object_start("limits");
+    json_uint("min_width", res->min_width);
+    json_uint("max_width", res->max_width);
+    json_uint("min_height", res->min_height);
+    json_uint("max_height", res->max_height);
+    json_object_end();
+
+    drm_json_conns(fd, res);
+    drm_json_encoders(fd, res);
+    drm_json_crtcs(fd, res);
+    drm_json_planes(fd, res);
+    drm_json_fbformats(fd);
+
+    json_object_end();
+    json_finish();
+    drmModeFreeResources(res);
+}
+
+static int drm_json_diff(const char *old, const char *new)
+{
+    struct json_node *a, *b;
+    int diffs;
+
+    a = json_parse_file(old);
+    b = json_parse_file(new);
+    diffs = json_diff(stdout, a, b);
+    json_free(a);
+    json_free(b);
+    return diffs ? 1 : 0;
+}
+
 /* ------------------------------------------------------------------ */
 
 static void complete_output(int card)
@@ -481,12 +1107,17 @@ static void usage(FILE *fp)
             "  -f | --formats          print supported formats\n"
             "  -F | --test-formats     print testable (drmtest) formats\n"
             "  -r | --properties       list object properties\n"
+            "  -e | --edid             decode connector edid\n"
             "  -l | --list-formats     list all known formats\n"
+            "       --json             print all card info as json snapshot\n"
+            "       --diff <old> <new> compare two json snapshots\n"
             "\n");
 }
 
 enum {
     OPT_LONG_LEASE = 0x100,
+    OPT_LONG_JSON,
+    OPT_LONG_DIFF,
     OPT_LONG_COMP_BASH,
     OPT_LONG_COMP_CARD,
     OPT_LONG_COMP_OUTPUT,
@@ -530,10 +1161,22 @@ static struct option long_opts[] = {
         .name    = "properties",
         .has_arg = false,
         .val     = 'p',
+    },{
+        .name    = "edid",
+        .has_arg = false,
+        .val     = 'e',
     },{
         .name    = "list-formats",
         .has_arg = false,
         .val     = 'l',
+    },{
+        .name    = "json",
+        .has_arg = false,
+        .val     = OPT_LONG_JSON,
+    },{
+        .name    = "diff",
+        .has_arg = false,
+        .val     = OPT_LONG_DIFF,
     },{
         .name    = "complete-bash",
         .has_arg = false,
@@ -572,12 +1215,15 @@ int main(int argc, char **argv)
     bool plane = false;
     bool modifiers = false;
     bool properties = false;
+    bool edid = false;
     bool format = false;
     bool listonly = false;
+    bool json = false;
+    bool diff = false;
     char *columns;
 
     for (;;) {
-        c = getopt_long(argc, argv, "hlaAmsopPfFrc:", long_opts, NULL);
+        c = getopt_long(argc, argv, "hlaAmsopPfFrec:", long_opts, NULL);
         if (c == -1)
             break;
         switch (c) {
@@ -615,6 +1261,9 @@ int main(int argc, char **argv)
         case 'r':
             properties = true;
             break;
+        case 'e':
+            edid = true;
+            break;
         case 'F':
             /* fall through */
             listonly = true;
@@ -624,6 +1273,12 @@ int main(int argc, char **argv)
         case OPT_LONG_LEASE:
             lease_fd = drm_lease(optarg);
             break;
+        case OPT_LONG_JSON:
+            json = true;
+            break;
+        case OPT_LONG_DIFF:
+            diff = true;
+            break;
         case OPT_LONG_COMP_BASH:
             complete_bash("drminfo", long_opts);
             exit(0);
@@ -642,6 +1297,14 @@ int main(int argc, char **argv)
         }
     }
 
+    if (diff) {
+        if (optind + 2 != argc) {
+            usage(stderr);
+            exit(1);
+        }
+        exit(drm_json_diff(argv[optind], argv[optind + 1]));
+    }
+
     columns = getenv("COLUMNS");
     if (columns) {
         ttycols = atoi(columns);
@@ -661,12 +1324,18 @@ int main(int argc, char **argv)
         fd = drm_open(card);
     }
 
+    if (json) {
+        drm_info_json(fd);
+        logind_fini();
+        return 0;
+    }
+
     if (misc)
         drm_info_misc(fd);
     if (caps)
         drm_info_caps(fd);
     if (conn)
-        drm_info_conns(fd, properties);
+        drm_info_conns(fd, properties, edid);
     if (plane)
         drm_info_planes(fd, modifiers, properties);
     if (format)
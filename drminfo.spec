@@ -27,6 +27,7 @@ BuildRequires: pkgconfig(libinput)
 drminfo - print drm device props
 drmtest - some drm test app
 egltest - opengl info and test app
+fbbench - fbdev vs. drm dumb buffer throughput
 fbinfo - print some fbdev device info
 fbtest - simple fbdev device test
 prime - some dma-buf sharing tests
@@ -47,7 +48,7 @@ mkdir -p %{buildroot}%{_datadir}/%{name}
 cp -a tests %{buildroot}%{_datadir}/%{name}
 
 mkdir -p %{buildroot}/etc/bash_completion.d
-for tool in drminfo drmtest egltest fbinfo fbtest prime virtiotest
+for tool in drminfo drmtest egltest fbbench fbinfo fbtest prime virtiotest
 do
 	build-rpm/$tool --complete-bash \
 		>> %{buildroot}/etc/bash_completion.d/drminfo
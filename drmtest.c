@@ -567,6 +567,7 @@ int main(int argc, char **argv)
     char *output = NULL;
     char *format = NULL;
     char *modename = NULL;
+    char *ifile = NULL;
     bool dmabuf = false;
     bool autotest = false;
     bool pixman = false;
@@ -610,7 +611,7 @@ int main(int argc, char **argv)
             secs = atoi(optarg);
             break;
         case 'i':
-            image = load_image(optarg);
+            ifile = optarg;
             break;
         case 'o':
             output = optarg;
@@ -661,6 +662,8 @@ int main(int argc, char **argv)
     logind_init();
     drm_init_dev(card, output, modename, false, lease_fd);
     drm_get_caps();
+    if (ifile)
+        image = load_image(ifile, drm_mode->hdisplay, drm_mode->vdisplay);
 
     if (dmabuf && !have_export) {
         fprintf(stderr, "dambuf export not supported by %s\n", version->name);
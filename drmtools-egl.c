@@ -10,6 +10,7 @@
 
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/select.h>
 
 #include <gbm.h>
 #include <epoxy/gl.h>
@@ -32,13 +33,18 @@ static EGLConfig cfg;
 static EGLContext ctx;
 static EGLSurface surface;
 
+/* headless: render into a fbo, no display */
+static bool headless, headless_sync;
+static GLuint headless_fbo, headless_rb;
+static GLsync headless_fence;
+
 /* ------------------------------------------------------------------ */
 
-int drm_setup_egl(void)
+static int drm_egl_init(EGLint surface_type)
 {
-    static const EGLint conf_att[] = {
+    EGLint conf_att[] = {
         EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
-        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+        EGL_SURFACE_TYPE, surface_type,
         EGL_RED_SIZE,   5,
         EGL_GREEN_SIZE, 5,
         EGL_BLUE_SIZE,  5,
@@ -52,6 +58,42 @@ int drm_setup_egl(void)
     EGLBoolean b;
     EGLint n;
 
+    b = eglInitialize(dpy, &major, &minor);
+    if (b == EGL_FALSE) {
+        fprintf(stderr, "egl: eglInitialize failed\n");
+        return -1;
+    }
+
+    b = eglBindAPI(EGL_OPENGL_API);
+    if (b == EGL_FALSE) {
+        fprintf(stderr, "egl: eglBindAPI failed\n");
+        return -1;
+    }
+
+    b = eglChooseConfig(dpy, conf_att, &cfg, 1, &n);
+    if (b == EGL_FALSE || n != 1) {
+        fprintf(stderr, "egl: eglChooseConfig failed\n");
+        return -1;
+    }
+
+    ctx = eglCreateContext(dpy, cfg, EGL_NO_CONTEXT, ctx_att);
+    if (ctx == EGL_NO_CONTEXT) {
+        fprintf(stderr, "egl: eglCreateContext failed\n");
+        return -1;
+    }
+
+    b = eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx);
+    if (b == EGL_FALSE) {
+        fprintf(stderr, "egl: eglMakeCurrent(EGL_NO_SURFACE) failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+int drm_setup_egl(void)
+{
+    EGLBoolean b;
+
     gbm_dev = gbm_create_device(drm_fd);
     if (!gbm_dev) {
         fprintf(stderr, "egl: gbm_create_device failed\n");
@@ -78,61 +120,177 @@ int drm_setup_egl(void)
         return -1;
     }
 
-    b = eglInitialize(dpy, &major, &minor);
-    if (b == EGL_FALSE) {
-        fprintf(stderr, "egl: eglInitialize failed\n");
+    if (drm_egl_init(EGL_WINDOW_BIT) < 0)
         return -1;
-    }
 
-    b = eglBindAPI(EGL_OPENGL_API);
-    if (b == EGL_FALSE) {
-        fprintf(stderr, "egl: eglBindAPI failed\n");
+    surface = eglCreateWindowSurface(dpy, cfg,
+                                     (EGLNativeWindowType)gbm_surface,
+                                     NULL);
+    if (!surface) {
+        fprintf(stderr, "egl: eglCreateWindowSurface failed\n");
         return -1;
     }
 
-    b = eglChooseConfig(dpy, conf_att, &cfg, 1, &n);
-    if (b == EGL_FALSE || n != 1) {
-        fprintf(stderr, "egl: eglChooseConfig failed\n");
+    b = eglMakeCurrent(dpy, surface, surface, ctx);
+    if (b == EGL_FALSE) {
+        fprintf(stderr, "egl: eglMakeCurrent(surface) failed\n");
         return -1;
     }
+    return 0;
+}
 
-    ctx = eglCreateContext(dpy, cfg, EGL_NO_CONTEXT, ctx_att);
-    if (ctx == EGL_NO_CONTEXT) {
-        fprintf(stderr, "egl: eglCreateContext failed\n");
+/*
+ * No kms, no outputs needed.  With a render node (/dev/dri/renderD*)
+ * egl runs on gbm, without one on the mesa surfaceless platform.  The
+ * context has no surface, rendering goes to a fbo which stays bound.
+ */
+int drm_setup_egl_headless(const char *node, uint32_t width, uint32_t height)
+{
+    if (node) {
+        drm_fd = open(node, O_RDWR | O_CLOEXEC);
+        if (drm_fd < 0) {
+            fprintf(stderr, "open %s: %s\n", node, strerror(errno));
+            return -1;
+        }
+        version = drmGetVersion(drm_fd);
+        gbm_dev = gbm_create_device(drm_fd);
+        if (!gbm_dev) {
+            fprintf(stderr, "egl: gbm_create_device failed\n");
+            return -1;
+        }
+#ifdef EGL_MESA_platform_gbm
+        dpy = eglGetPlatformDisplayEXT(EGL_PLATFORM_GBM_MESA, gbm_dev, NULL);
+#else
+        dpy = eglGetDisplay(gbm_dev);
+#endif
+    } else {
+        drm_fd = -1;
+#ifdef EGL_MESA_platform_surfaceless
+        dpy = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA,
+                                       EGL_DEFAULT_DISPLAY, NULL);
+#else
+        fprintf(stderr, "egl: no surfaceless platform support\n");
         return -1;
+#endif
     }
-
-    b = eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx);
-    if (b == EGL_FALSE) {
-        fprintf(stderr, "egl: eglMakeCurrent(EGL_NO_SURFACE) failed\n");
+    if (dpy == EGL_NO_DISPLAY) {
+        fprintf(stderr, "egl: eglGetDisplay failed\n");
         return -1;
     }
 
-    surface = eglCreateWindowSurface(dpy, cfg,
-                                     (EGLNativeWindowType)gbm_surface,
-                                     NULL);
-    if (!surface) {
-        fprintf(stderr, "egl: eglCreateWindowSurface failed\n");
+    /* any surface type, we never create one */
+    if (drm_egl_init(0) < 0)
+        return -1;
+    if (!epoxy_has_egl_extension(dpy, "EGL_KHR_surfaceless_context")) {
+        fprintf(stderr, "egl: EGL_KHR_surfaceless_context not supported\n");
         return -1;
     }
 
-    b = eglMakeCurrent(dpy, surface, surface, ctx);
-    if (b == EGL_FALSE) {
-        fprintf(stderr, "egl: eglMakeCurrent(surface) failed\n");
+    glGenRenderbuffers(1, &headless_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenFramebuffers(1, &headless_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, headless_rb);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "egl: headless framebuffer incomplete\n");
         return -1;
     }
+    glViewport(0, 0, width, height);
+    headless = true;
+    headless_sync = (epoxy_gl_version() >= 32 ||
+                     epoxy_has_gl_extension("GL_ARB_sync"));
     return 0;
 }
 
-static int fbid;
+/* ------------------------------------------------------------------ */
+
 static struct gbm_bo *bo;
+static bool crtc_set;
+static bool flip_pending;
+
+static void drm_egl_destroy_fb(struct gbm_bo *fbo, void *data)
+{
+    uint32_t *fb = data;
+
+    drmModeRmFB(drm_fd, *fb);
+    free(fb);
+}
+
+/* framebuffers are created once per gbm_bo, then cached */
+static uint32_t drm_egl_bo_fb(struct gbm_bo *fbo)
+{
+    uint32_t *fb = gbm_bo_get_user_data(fbo);
+    int rc;
+
+    if (fb)
+        return *fb;
+
+    fb = malloc(sizeof(*fb));
+    rc = drmModeAddFB(drm_fd,
+                      gbm_bo_get_width(fbo), gbm_bo_get_height(fbo),
+                      24, 32, gbm_bo_get_stride(fbo),
+                      gbm_bo_get_handle(fbo).u32, fb);
+    if (rc < 0) {
+        fprintf(stderr, "egl: drmModeAddFB() failed: %s\n", strerror(errno));
+        exit(1);
+    }
+    gbm_bo_set_user_data(fbo, fb, drm_egl_destroy_fb);
+    return *fb;
+}
+
+static void drm_egl_flip_done(int fd, unsigned int sequence,
+                              unsigned int tv_sec, unsigned int tv_usec,
+                              void *data)
+{
+    flip_pending = false;
+}
+
+static void drm_egl_wait_flip(void)
+{
+    drmEventContext ev = {
+        .version = 2,
+        .page_flip_handler = drm_egl_flip_done,
+    };
+    fd_set set;
+    int rc;
+
+    while (flip_pending) {
+        FD_ZERO(&set);
+        FD_SET(drm_fd, &set);
+        rc = select(drm_fd + 1, &set, NULL, NULL, NULL);
+        if (rc < 0 && errno != EINTR) {
+            fprintf(stderr, "egl: select: %s\n", strerror(errno));
+            exit(1);
+        }
+        if (rc > 0)
+            drmHandleEvent(drm_fd, &ev);
+    }
+}
 
 void drm_egl_flush_display(void)
 {
-    uint32_t handle, stride, newfb;
     struct gbm_bo *newbo;
+    uint32_t newfb;
     int rc;
 
+    if (headless) {
+        /* nothing to show, throttle to one frame in flight like a swap */
+        if (!headless_sync) {
+            glFinish();
+            return;
+        }
+        if (headless_fence) {
+            glClientWaitSync(headless_fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                             GL_TIMEOUT_IGNORED);
+            glDeleteSync(headless_fence);
+        }
+        headless_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        return;
+    }
+
     eglSwapBuffers(dpy, surface);
 
     newbo = gbm_surface_lock_front_buffer(gbm_surface);
@@ -140,24 +298,30 @@ void drm_egl_flush_display(void)
         fprintf(stderr, "egl: gbm_surface_lock_front_buffer failed\n");
         return;
     }
-    handle = gbm_bo_get_handle(newbo).u32;
-    stride = gbm_bo_get_stride(newbo);
+    newfb = drm_egl_bo_fb(newbo);
 
-    drmModeAddFB(drm_fd, drm_mode->hdisplay, drm_mode->vdisplay, 24, 32,
-                 stride, handle, &newfb);
-    rc = drmModeSetCrtc(drm_fd, drm_enc->crtc_id, newfb, 0, 0,
-                        &drm_conn->connector_id, 1,
-                        &drm_conn->modes[0]);
-    if (rc < 0) {
-        fprintf(stderr, "egl: drmModeSetCrtc() failed\n");
-        exit(1);
+    /* modeset for the first frame only, page flip afterwards */
+    rc = -1;
+    if (crtc_set) {
+        rc = drmModePageFlip(drm_fd, drm_enc->crtc_id, newfb,
+                             DRM_MODE_PAGE_FLIP_EVENT, NULL);
+        if (rc == 0) {
+            flip_pending = true;
+            drm_egl_wait_flip();
+        }
     }
-
-    if (fbid) {
-        drmModeRmFB(drm_fd, fbid);
+    if (rc < 0) {
+        rc = drmModeSetCrtc(drm_fd, drm_enc->crtc_id, newfb, 0, 0,
+                            &drm_conn->connector_id, 1,
+                            drm_mode);
+        if (rc < 0) {
+            fprintf(stderr, "egl: drmModeSetCrtc() failed\n");
+            exit(1);
+        }
+        crtc_set = true;
     }
-    fbid = newfb;
 
+    /* previous buffer is off screen now, hand it back to gbm */
     if (bo) {
         gbm_surface_release_buffer(gbm_surface, bo);
     }
@@ -24,6 +24,7 @@ uint64_t drm_get_property_value(int fd, uint32_t id, uint32_t objtype,
                                 const char *name);
 bool drm_probe_format_primary(const struct fbformat *fmt);
 bool drm_probe_format_cursor(const struct fbformat *fmt);
+bool drm_probe_format_overlay(const struct fbformat *fmt);
 void drm_plane_init(int fd);
 
 bool drm_probe_format_fb(int fd, const struct fbformat *fmt);
@@ -50,4 +51,5 @@ void drm_show_fb(void);
 
 /* drmtools-egl.c */
 int drm_setup_egl(void);
+int drm_setup_egl_headless(const char *node, uint32_t width, uint32_t height);
 void drm_egl_flush_display(void);
@@ -0,0 +1,386 @@
+/*
+ * drm call tracing: count calls and measure latencies.
+ *
+ * The calls listed in drmtrace.h are wrapped at link time
+ * ("ld --wrap=<name>", see meson.build), so the tools don't need any
+ * changes.  Tracing is off unless enabled via environment:
+ *
+ *   DRM_TRACE=1             print call statistics to stderr at exit
+ *                           and on SIGUSR1.
+ *   DRM_TRACE_JSON=<file>   write chrome trace events to <file> at
+ *                           exit (load in chrome://tracing or perfetto).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/dma-buf.h>
+#include <libdrm/virtgpu_drm.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "drmtrace.h"
+
+#define ARRAY_SIZE(_x) (sizeof(_x)/sizeof(_x[0]))
+
+#define HIST_BUCKETS  24            /* log2(usecs), last is open-ended */
+#define IOCTL_SLOTS   64
+#define EVENT_MAX     (256 * 1024)
+
+/* ------------------------------------------------------------------ */
+
+struct trace_stat {
+    char          name[32];
+    unsigned long request;          /* drmIoctl() slots only */
+    uint64_t      count;
+    uint64_t      total_ns;
+    uint64_t      min_ns;
+    uint64_t      max_ns;
+    uint64_t      hist[HIST_BUCKETS];
+};
+
+struct trace_event {
+    struct trace_stat *stat;
+    uint64_t          start_ns;
+    uint64_t          dur_ns;
+    pid_t             tid;
+};
+
+enum {
+#define TRACE_ENUM(_ret, _name, _proto, _args) TRACE_##_name,
+    DRM_TRACE_CALLS(TRACE_ENUM)
+#undef TRACE_ENUM
+    TRACE_CALLS_COUNT,
+};
+
+static const char *call_names[] = {
+#define TRACE_NAME(_ret, _name, _proto, _args) [TRACE_##_name] = #_name,
+    DRM_TRACE_CALLS(TRACE_NAME)
+#undef TRACE_NAME
+};
+
+static const struct {
+    unsigned long request;
+    const char    *name;
+} ioctl_names[] = {
+    /* full request number, drmIoctl() is used for non-drm ioctls too */
+    { DRM_IOCTL_GEM_CLOSE,                  "GEM_CLOSE"                 },
+    { DRM_IOCTL_MODE_CREATE_DUMB,           "MODE_CREATE_DUMB"          },
+    { DRM_IOCTL_MODE_MAP_DUMB,              "MODE_MAP_DUMB"             },
+    { DRM_IOCTL_MODE_DESTROY_DUMB,          "MODE_DESTROY_DUMB"         },
+    { DRM_IOCTL_MODE_CURSOR2,               "MODE_CURSOR2"              },
+    { DRM_IOCTL_VIRTGPU_MAP,                "VIRTGPU_MAP"               },
+    { DRM_IOCTL_VIRTGPU_EXECBUFFER,         "VIRTGPU_EXECBUFFER"        },
+    { DRM_IOCTL_VIRTGPU_GETPARAM,           "VIRTGPU_GETPARAM"          },
+    { DRM_IOCTL_VIRTGPU_RESOURCE_CREATE,    "VIRTGPU_RESOURCE_CREATE"   },
+    { DRM_IOCTL_VIRTGPU_RESOURCE_INFO,      "VIRTGPU_RESOURCE_INFO"     },
+    { DRM_IOCTL_VIRTGPU_TRANSFER_FROM_HOST, "VIRTGPU_TRANSFER_FROM_HOST"},
+    { DRM_IOCTL_VIRTGPU_TRANSFER_TO_HOST,   "VIRTGPU_TRANSFER_TO_HOST"  },
+    { DRM_IOCTL_VIRTGPU_WAIT,               "VIRTGPU_WAIT"              },
+    { DRM_IOCTL_VIRTGPU_GET_CAPS,           "VIRTGPU_GET_CAPS"          },
+#ifdef DRM_IOCTL_VIRTGPU_RESOURCE_CREATE_BLOB
+    { DRM_IOCTL_VIRTGPU_RESOURCE_CREATE_BLOB, "VIRTGPU_RESOURCE_CREATE_BLOB" },
+#endif
+    { DMA_BUF_IOCTL_SYNC,                   "DMA_BUF_SYNC"              },
+};
+
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static bool trace_enabled;
+static struct trace_stat calls[TRACE_CALLS_COUNT];
+static struct trace_stat ioctls[IOCTL_SLOTS];
+
+static const char *json_file;
+static struct trace_event *events;
+static uint32_t event_count;
+
+/* ------------------------------------------------------------------ */
+
+static uint64_t trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* plain write(2), so it can be used from the signal handler */
+static void trace_printf(const char *fmt, ...)
+{
+    char buf[256];
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len > sizeof(buf) - 1)
+        len = sizeof(buf) - 1;
+    if (len > 0)
+        write(STDERR_FILENO, buf, len);
+}
+
+static void trace_print_stat(struct trace_stat *st)
+{
+    uint64_t count = st->count;
+    int i;
+
+    if (!count)
+        return;
+    trace_printf("    %-28s %8" PRIu64 " %10" PRIu64 " %8" PRIu64
+                 " %8" PRIu64 " %8" PRIu64 "\n",
+                 st->name, count,
+                 st->total_ns / 1000,
+                 st->total_ns / count / 1000,
+                 st->min_ns / 1000,
+                 st->max_ns / 1000);
+    trace_printf("        histogram:");
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        if (!st->hist[i])
+            continue;
+        trace_printf(" %s%" PRIu64 "us:%" PRIu64,
+                     i == HIST_BUCKETS - 1 ? ">=" : "<",
+                     (uint64_t)1 << (i == HIST_BUCKETS - 1 ? i - 1 : i),
+                     st->hist[i]);
+    }
+    trace_printf("\n");
+}
+
+void drm_trace_dump(void)
+{
+    int i;
+
+    if (!trace_enabled)
+        return;
+
+    trace_printf("drm trace (pid %d, latencies in us)\n", getpid());
+    trace_printf("    %-28s %8s %10s %8s %8s %8s\n",
+                 "call", "count", "total", "avg", "min", "max");
+    for (i = 0; i < ARRAY_SIZE(calls); i++)
+        trace_print_stat(&calls[i]);
+    for (i = 0; i < ARRAY_SIZE(ioctls); i++)
+        trace_print_stat(&ioctls[i]);
+    trace_printf("\n");
+}
+
+static void trace_write_json(void)
+{
+    struct trace_event *ev;
+    uint32_t i, count;
+    FILE *fp;
+
+    fp = fopen(json_file, "w");
+    if (!fp) {
+        perror(json_file);
+        return;
+    }
+
+    count = event_count;
+    if (count > EVENT_MAX) {
+        fprintf(stderr, "drm trace: %d events dropped\n", count - EVENT_MAX);
+        count = EVENT_MAX;
+    }
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (i = 0; i < count; i++) {
+        ev = events + i;
+        fprintf(fp, "{\"name\":\"%s\",\"cat\":\"drm\",\"ph\":\"X\","
+                "\"ts\":%" PRIu64 ".%03" PRIu64 ","
+                "\"dur\":%" PRIu64 ".%03" PRIu64 ","
+                "\"pid\":%d,\"tid\":%d}%s\n",
+                ev->stat->name,
+                ev->start_ns / 1000, ev->start_ns % 1000,
+                ev->dur_ns / 1000, ev->dur_ns % 1000,
+                getpid(), ev->tid,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(fp, "],\"displayTimeUnit\":\"ns\"}\n");
+    fclose(fp);
+}
+
+static void trace_exit(void)
+{
+    if (getenv("DRM_TRACE"))
+        drm_trace_dump();
+    if (events)
+        trace_write_json();
+}
+
+static void trace_signal(int signal)
+{
+    drm_trace_dump();
+}
+
+static void trace_setup(void)
+{
+    struct sigaction act, old;
+    int i;
+
+    json_file = getenv("DRM_TRACE_JSON");
+    if (!getenv("DRM_TRACE") && !json_file)
+        return;
+
+    for (i = 0; i < ARRAY_SIZE(calls); i++) {
+        snprintf(calls[i].name, sizeof(calls[i].name), "%s", call_names[i]);
+        calls[i].min_ns = UINT64_MAX;
+    }
+    for (i = 0; i < ARRAY_SIZE(ioctls); i++)
+        ioctls[i].min_ns = UINT64_MAX;
+
+    if (json_file) {
+        events = calloc(EVENT_MAX, sizeof(*events));
+        if (!events)
+            json_file = NULL;
+    }
+
+    /* don't steal SIGUSR1 from the application */
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = trace_signal;
+    act.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, NULL, &old);
+    if (old.sa_handler == SIG_DFL)
+        sigaction(SIGUSR1, &act, NULL);
+
+    atexit(trace_exit);
+    trace_enabled = true;
+}
+
+/* wrapped calls can come from multiple threads (prime, virtiotest) */
+static bool trace_init(void)
+{
+    pthread_once(&trace_once, trace_setup);
+    return trace_enabled;
+}
+
+/* ------------------------------------------------------------------ */
+
+static void trace_update_min(uint64_t *min, uint64_t val)
+{
+    uint64_t old = __atomic_load_n(min, __ATOMIC_RELAXED);
+
+    while (val < old &&
+           !__atomic_compare_exchange_n(min, &old, val, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void trace_update_max(uint64_t *max, uint64_t val)
+{
+    uint64_t old = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+    while (val > old &&
+           !__atomic_compare_exchange_n(max, &old, val, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void trace_record(struct trace_stat *st, uint64_t start)
+{
+    uint64_t dur = trace_now() - start;
+    uint64_t us = dur / 1000;
+    uint32_t idx;
+    int bucket = 0;
+
+    while (us && bucket < HIST_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+
+    __atomic_fetch_add(&st->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&st->total_ns, dur, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&st->hist[bucket], 1, __ATOMIC_RELAXED);
+    trace_update_min(&st->min_ns, dur);
+    trace_update_max(&st->max_ns, dur);
+
+    if (events) {
+        idx = __atomic_fetch_add(&event_count, 1, __ATOMIC_RELAXED);
+        if (idx < EVENT_MAX) {
+            events[idx].stat = st;
+            events[idx].start_ns = start;
+            events[idx].dur_ns = dur;
+            events[idx].tid = syscall(SYS_gettid);
+        }
+    }
+}
+
+static struct trace_stat *trace_ioctl_slot(unsigned long request)
+{
+    unsigned long empty;
+    int i, j;
+
+    for (i = 0; i < ARRAY_SIZE(ioctls); i++) {
+        if (ioctls[i].request == request)
+            return ioctls + i;
+        if (ioctls[i].request)
+            continue;
+
+        /* claim empty slot, another thread might race us */
+        empty = 0;
+        if (!__atomic_compare_exchange_n(&ioctls[i].request, &empty, request,
+                                         false, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE)) {
+            if (empty == request)
+                return ioctls + i;
+            continue;
+        }
+        for (j = 0; j < ARRAY_SIZE(ioctl_names); j++) {
+            if (ioctl_names[j].request == request) {
+                snprintf(ioctls[i].name, sizeof(ioctls[i].name),
+                         "ioctl %s", ioctl_names[j].name);
+                return ioctls + i;
+            }
+        }
+        snprintf(ioctls[i].name, sizeof(ioctls[i].name),
+                 "ioctl '%c' 0x%02lx", (char)_IOC_TYPE(request),
+                 (unsigned long)_IOC_NR(request));
+        return ioctls + i;
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------ */
+
+int __real_drmIoctl(int fd, unsigned long request, void *arg);
+int __wrap_drmIoctl(int fd, unsigned long request, void *arg)
+{
+    struct trace_stat *st;
+    uint64_t start;
+    int ret;
+
+    if (!trace_init())
+        return __real_drmIoctl(fd, request, arg);
+
+    start = trace_now();
+    ret = __real_drmIoctl(fd, request, arg);
+    st = trace_ioctl_slot(request);
+    if (st)
+        trace_record(st, start);
+    return ret;
+}
+
+#define TRACE_WRAP(_ret, _name, _proto, _args)                          \
+    _ret __real_##_name _proto;                                         \
+    _ret __wrap_##_name _proto                                          \
+    {                                                                   \
+        uint64_t start;                                                 \
+        _ret ret;                                                       \
+                                                                        \
+        if (!trace_init())                                              \
+            return __real_##_name _args;                                \
+                                                                        \
+        start = trace_now();                                            \
+        ret = __real_##_name _args;                                     \
+        trace_record(&calls[TRACE_##_name], start);                     \
+        return ret;                                                     \
+    }
+
+DRM_TRACE_CALLS(TRACE_WRAP)
@@ -0,0 +1,61 @@
+/*
+ * libdrm calls wrapped by drmtrace.c (via "ld --wrap=<name>").
+ * Keep in sync with drmtrace_wrap in meson.build.
+ *
+ *   X(return type, name, prototype, arguments)
+ */
+#define DRM_TRACE_CALLS(X)                                              \
+    X(drmVersionPtr, drmGetVersion, (int fd), (fd))                     \
+    X(int, drmGetCap,                                                   \
+      (int fd, uint64_t cap, uint64_t *value), (fd, cap, value))        \
+    X(int, drmSetClientCap,                                             \
+      (int fd, uint64_t cap, uint64_t value), (fd, cap, value))         \
+    X(char *, drmGetBusid, (int fd), (fd))                              \
+    X(int, drmSetMaster, (int fd), (fd))                                \
+    X(int, drmHandleEvent,                                              \
+      (int fd, drmEventContextPtr ev), (fd, ev))                        \
+    X(int, drmPrimeHandleToFD,                                          \
+      (int fd, uint32_t handle, uint32_t flags, int *prime_fd),         \
+      (fd, handle, flags, prime_fd))                                    \
+    X(int, drmPrimeFDToHandle,                                          \
+      (int fd, int prime_fd, uint32_t *handle),                         \
+      (fd, prime_fd, handle))                                           \
+    X(drmModeResPtr, drmModeGetResources, (int fd), (fd))               \
+    X(drmModeConnectorPtr, drmModeGetConnector,                         \
+      (int fd, uint32_t id), (fd, id))                                  \
+    X(drmModeEncoderPtr, drmModeGetEncoder,                             \
+      (int fd, uint32_t id), (fd, id))                                  \
+    X(drmModeCrtcPtr, drmModeGetCrtc,                                   \
+      (int fd, uint32_t id), (fd, id))                                  \
+    X(int, drmModeSetCrtc,                                              \
+      (int fd, uint32_t crtc, uint32_t fb, uint32_t x, uint32_t y,      \
+       uint32_t *conns, int count, drmModeModeInfoPtr mode),            \
+      (fd, crtc, fb, x, y, conns, count, mode))                         \
+    X(drmModePlaneResPtr, drmModeGetPlaneResources, (int fd), (fd))     \
+    X(drmModePlanePtr, drmModeGetPlane,                                 \
+      (int fd, uint32_t id), (fd, id))                                  \
+    X(drmModeObjectPropertiesPtr, drmModeObjectGetProperties,           \
+      (int fd, uint32_t id, uint32_t type), (fd, id, type))             \
+    X(drmModePropertyPtr, drmModeGetProperty,                           \
+      (int fd, uint32_t id), (fd, id))                                  \
+    X(drmModePropertyBlobPtr, drmModeGetPropertyBlob,                   \
+      (int fd, uint32_t id), (fd, id))                                  \
+    X(int, drmModeAddFB,                                                \
+      (int fd, uint32_t width, uint32_t height, uint8_t depth,          \
+       uint8_t bpp, uint32_t pitch, uint32_t handle, uint32_t *fb),     \
+      (fd, width, height, depth, bpp, pitch, handle, fb))               \
+    X(int, drmModeAddFB2,                                               \
+      (int fd, uint32_t width, uint32_t height, uint32_t fourcc,        \
+       const uint32_t handles[4], const uint32_t pitches[4],            \
+       const uint32_t offsets[4], uint32_t *fb, uint32_t flags),        \
+      (fd, width, height, fourcc, handles, pitches, offsets, fb, flags)) \
+    X(drmModeFBPtr, drmModeGetFB, (int fd, uint32_t fb), (fd, fb))      \
+    X(int, drmModeRmFB, (int fd, uint32_t fb), (fd, fb))                \
+    X(int, drmModeDirtyFB,                                              \
+      (int fd, uint32_t fb, drmModeClipPtr clips, uint32_t count),      \
+      (fd, fb, clips, count))                                           \
+    X(int, drmModePageFlip,                                             \
+      (int fd, uint32_t crtc, uint32_t fb, uint32_t flags, void *data), \
+      (fd, crtc, fb, flags, data))
+
+void drm_trace_dump(void);
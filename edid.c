@@ -0,0 +1,307 @@
+/*
+ * edid decoder: base block (vendor, product, detailed timings,
+ * display descriptors) and cea-861 extension blocks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "edid.h"
+
+#define ARRAY_SIZE(_x) (sizeof(_x)/sizeof(_x[0]))
+
+#define EDID_BLOCK_SIZE   128
+
+/* cea-861 short video descriptors (same conventions as the kernel) */
+static const struct {
+    uint8_t  vic;
+    uint16_t hdisplay, vdisplay;
+    uint8_t  vrefresh;
+    bool     interlace;
+} cea_vics[] = {
+    {  1,  640,  480,  60, false }, {  2,  720,  480,  60, false },
+    {  3,  720,  480,  60, false }, {  4, 1280,  720,  60, false },
+    {  5, 1920, 1080,  60, true  }, {  6,  720,  480,  60, true  },
+    {  7,  720,  480,  60, true  }, {  8,  720,  240,  60, false },
+    {  9,  720,  240,  60, false }, { 10, 2880,  480,  60, true  },
+    { 11, 2880,  480,  60, true  }, { 12, 2880,  240,  60, false },
+    { 13, 2880,  240,  60, false }, { 14, 1440,  480,  60, false },
+    { 15, 1440,  480,  60, false }, { 16, 1920, 1080,  60, false },
+    { 17,  720,  576,  50, false }, { 18,  720,  576,  50, false },
+    { 19, 1280,  720,  50, false }, { 20, 1920, 1080,  50, true  },
+    { 21,  720,  576,  50, true  }, { 22,  720,  576,  50, true  },
+    { 23,  720,  288,  50, false }, { 24,  720,  288,  50, false },
+    { 25, 2880,  576,  50, true  }, { 26, 2880,  576,  50, true  },
+    { 27, 2880,  288,  50, false }, { 28, 2880,  288,  50, false },
+    { 29, 1440,  576,  50, false }, { 30, 1440,  576,  50, false },
+    { 31, 1920, 1080,  50, false }, { 32, 1920, 1080,  24, false },
+    { 33, 1920, 1080,  25, false }, { 34, 1920, 1080,  30, false },
+    { 35, 2880,  480,  60, false }, { 36, 2880,  480,  60, false },
+    { 37, 2880,  576,  50, false }, { 38, 2880,  576,  50, false },
+    { 39, 1920, 1080,  50, true  }, { 40, 1920, 1080, 100, true  },
+    { 41, 1280,  720, 100, false }, { 42,  720,  576, 100, false },
+    { 43,  720,  576, 100, false }, { 44,  720,  576, 100, true  },
+    { 45,  720,  576, 100, true  }, { 46, 1920, 1080, 120, true  },
+    { 47, 1280,  720, 120, false }, { 48,  720,  480, 120, false },
+    { 49,  720,  480, 120, false }, { 50,  720,  480, 120, true  },
+    { 51,  720,  480, 120, true  }, { 52,  720,  576, 200, false },
+    { 53,  720,  576, 200, false }, { 54,  720,  576, 200, true  },
+    { 55,  720,  576, 200, true  }, { 56,  720,  480, 240, false },
+    { 57,  720,  480, 240, false }, { 58,  720,  480, 240, true  },
+    { 59,  720,  480, 240, true  }, { 60, 1280,  720,  24, false },
+    { 61, 1280,  720,  25, false }, { 62, 1280,  720,  30, false },
+    { 63, 1920, 1080, 120, false }, { 64, 1920, 1080, 100, false },
+    { 93, 3840, 2160,  24, false }, { 94, 3840, 2160,  25, false },
+    { 95, 3840, 2160,  30, false }, { 96, 3840, 2160,  50, false },
+    { 97, 3840, 2160,  60, false }, { 98, 4096, 2160,  24, false },
+    { 99, 4096, 2160,  25, false }, {100, 4096, 2160,  30, false },
+    {101, 4096, 2160,  50, false }, {102, 4096, 2160,  60, false },
+};
+
+/* ------------------------------------------------------------------ */
+
+static struct edid_mode *edid_add_mode(struct edid_info *info,
+                                       const char *source)
+{
+    struct edid_mode *m;
+
+    if (info->count_modes == EDID_MAX_MODES)
+        return NULL;
+    m = info->modes + info->count_modes++;
+    memset(m, 0, sizeof(*m));
+    m->source = source;
+    return m;
+}
+
+static void edid_parse_dtd(struct edid_info *info, const uint8_t *d,
+                           const char *source, bool preferred)
+{
+    drmModeModeInfo *mode;
+    struct edid_mode *m;
+    uint32_t hblank, vblank, hso, hsw, vso, vsw;
+    uint64_t num, den;
+
+    m = edid_add_mode(info, source);
+    if (!m)
+        return;
+    m->preferred = preferred;
+    mode = &m->mode;
+
+    hblank = d[3] | (d[4] & 0x0f) << 8;
+    vblank = d[6] | (d[7] & 0x0f) << 8;
+    hso    = d[8] | (d[11] & 0xc0) << 2;
+    hsw    = d[9] | (d[11] & 0x30) << 4;
+    vso    = (d[10] >> 4)   | (d[11] & 0x0c) << 2;
+    vsw    = (d[10] & 0x0f) | (d[11] & 0x03) << 4;
+
+    mode->clock       = (d[0] | d[1] << 8) * 10;
+    mode->hdisplay    = d[2] | (d[4] & 0xf0) << 4;
+    mode->hsync_start = mode->hdisplay + hso;
+    mode->hsync_end   = mode->hsync_start + hsw;
+    mode->htotal      = mode->hdisplay + hblank;
+    mode->vdisplay    = d[5] | (d[7] & 0xf0) << 4;
+    mode->vsync_start = mode->vdisplay + vso;
+    mode->vsync_end   = mode->vsync_start + vsw;
+    mode->vtotal      = mode->vdisplay + vblank;
+
+    if ((d[17] & 0x18) == 0x18) {
+        /* digital separate sync */
+        mode->flags |= (d[17] & 0x04) ? DRM_MODE_FLAG_PVSYNC : DRM_MODE_FLAG_NVSYNC;
+        mode->flags |= (d[17] & 0x02) ? DRM_MODE_FLAG_PHSYNC : DRM_MODE_FLAG_NHSYNC;
+    }
+    if (d[17] & 0x80) {
+        mode->flags |= DRM_MODE_FLAG_INTERLACE;
+        mode->vdisplay    *= 2;
+        mode->vsync_start *= 2;
+        mode->vsync_end   *= 2;
+        mode->vtotal       = mode->vtotal * 2 + 1;
+    }
+
+    num = (uint64_t)mode->clock * 1000;
+    den = (uint64_t)mode->htotal * mode->vtotal;
+    if (mode->flags & DRM_MODE_FLAG_INTERLACE)
+        num *= 2;
+    if (den)
+        mode->vrefresh = (num + den / 2) / den;
+
+    if (preferred)
+        mode->type |= DRM_MODE_TYPE_PREFERRED;
+    snprintf(mode->name, sizeof(mode->name), "%dx%d%s",
+             mode->hdisplay, mode->vdisplay,
+             (mode->flags & DRM_MODE_FLAG_INTERLACE) ? "i" : "");
+}
+
+static void edid_parse_string(char *dest, const uint8_t *d)
+{
+    int i;
+
+    /* 13 chars, terminated by 0x0a, padded with spaces */
+    for (i = 0; i < 13; i++) {
+        if (d[i] == 0x0a)
+            break;
+        dest[i] = (d[i] >= 0x20 && d[i] < 0x7f) ? d[i] : '?';
+    }
+    while (i > 0 && dest[i-1] == ' ')
+        i--;
+    dest[i] = 0;
+}
+
+static void edid_parse_descriptor(struct edid_info *info, const uint8_t *d,
+                                  bool preferred)
+{
+    if (d[0] || d[1]) {
+        edid_parse_dtd(info, d, "dtd", preferred);
+        return;
+    }
+
+    switch (d[3]) {
+    case 0xfc:
+        edid_parse_string(info->name, d + 5);
+        break;
+    case 0xff:
+        edid_parse_string(info->serial_str, d + 5);
+        break;
+    case 0xfd:
+        info->has_range = true;
+        info->min_vfreq = d[5] + ((d[4] & 0x01) ? 255 : 0);
+        info->max_vfreq = d[6] + ((d[4] & 0x02) ? 255 : 0);
+        info->min_hfreq = d[7] + ((d[4] & 0x04) ? 255 : 0);
+        info->max_hfreq = d[8] + ((d[4] & 0x08) ? 255 : 0);
+        info->max_clock = d[9] * 10;
+        break;
+    }
+}
+
+static void edid_parse_svd(struct edid_info *info, uint8_t svd)
+{
+    struct edid_mode *m;
+    uint8_t vic = svd;
+    int i;
+
+    /* vics 1-64 use bit 7 as "native" flag */
+    if ((svd & 0x7f) >= 1 && (svd & 0x7f) <= 64)
+        vic = svd & 0x7f;
+
+    for (i = 0; i < ARRAY_SIZE(cea_vics); i++) {
+        if (cea_vics[i].vic != vic)
+            continue;
+        m = edid_add_mode(info, "cea-vic");
+        if (!m)
+            return;
+        m->vic = vic;
+        m->preferred = (vic != svd);
+        m->mode.hdisplay = cea_vics[i].hdisplay;
+        m->mode.vdisplay = cea_vics[i].vdisplay;
+        m->mode.vrefresh = cea_vics[i].vrefresh;
+        if (cea_vics[i].interlace)
+            m->mode.flags |= DRM_MODE_FLAG_INTERLACE;
+        snprintf(m->mode.name, sizeof(m->mode.name), "%dx%d%s",
+                 m->mode.hdisplay, m->mode.vdisplay,
+                 cea_vics[i].interlace ? "i" : "");
+        return;
+    }
+}
+
+static void edid_parse_cea(struct edid_info *info, const uint8_t *b)
+{
+    uint8_t dtd = b[2];
+    int pos, tag, len, i;
+
+    info->has_cea = true;
+    info->cea_revision = b[1];
+    if (b[1] >= 2) {
+        info->cea_underscan = b[3] & 0x80;
+        info->cea_audio     = b[3] & 0x40;
+        info->cea_ycbcr444  = b[3] & 0x20;
+        info->cea_ycbcr422  = b[3] & 0x10;
+    }
+    if (dtd < 4 || dtd > EDID_BLOCK_SIZE - 1)
+        dtd = (dtd == 0) ? 4 : EDID_BLOCK_SIZE - 1;
+
+    /* data block collection (revision 3+) */
+    for (pos = 4; b[1] >= 3 && pos < dtd; pos += len + 1) {
+        tag = b[pos] >> 5;
+        len = b[pos] & 0x1f;
+        if (pos + len >= dtd)
+            break;
+        switch (tag) {
+        case 2: /* video */
+            for (i = 1; i <= len; i++)
+                edid_parse_svd(info, b[pos + i]);
+            break;
+        case 3: /* vendor specific */
+            if (len >= 3 &&
+                b[pos + 1] == 0x03 &&
+                b[pos + 2] == 0x0c &&
+                b[pos + 3] == 0x00)
+                info->cea_hdmi = true;
+            break;
+        }
+    }
+
+    /* detailed timing descriptors */
+    for (pos = dtd; pos + 18 <= EDID_BLOCK_SIZE - 1; pos += 18) {
+        if (!b[pos] && !b[pos + 1])
+            break;
+        edid_parse_dtd(info, b + pos, "cea-dtd", false);
+    }
+}
+
+static bool edid_checksum(const uint8_t *b)
+{
+    uint8_t sum = 0;
+    int i;
+
+    for (i = 0; i < EDID_BLOCK_SIZE; i++)
+        sum += b[i];
+    return sum == 0;
+}
+
+int edid_parse(struct edid_info *info, const uint8_t *data, size_t len)
+{
+    static const uint8_t header[8] = {
+        0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00
+    };
+    const uint8_t *b;
+    int i;
+
+    memset(info, 0, sizeof(*info));
+    if (len < EDID_BLOCK_SIZE ||
+        memcmp(data, header, sizeof(header)) != 0 ||
+        !edid_checksum(data))
+        return -1;
+
+    info->vendor[0] = '@' + ((data[8] >> 2) & 0x1f);
+    info->vendor[1] = '@' + (((data[8] & 0x03) << 3) | (data[9] >> 5));
+    info->vendor[2] = '@' + (data[9] & 0x1f);
+    info->product   = data[10] | data[11] << 8;
+    info->serial    = data[12] | data[13] << 8 | data[14] << 16 |
+                      (uint32_t)data[15] << 24;
+    info->week      = data[16];
+    info->year      = data[17] + 1990;
+    info->version   = data[18];
+    info->revision  = data[19];
+    info->width_cm  = data[21];
+    info->height_cm = data[22];
+
+    /* first descriptor is the preferred mode */
+    for (i = 0; i < 4; i++)
+        edid_parse_descriptor(info, data + 54 + i * 18, i == 0);
+
+    info->extensions = data[126];
+    for (i = 1; i <= info->extensions; i++) {
+        if ((i + 1) * EDID_BLOCK_SIZE > len)
+            break;
+        b = data + i * EDID_BLOCK_SIZE;
+        if (!edid_checksum(b))
+            continue;
+        if (b[0] == 0x02)
+            edid_parse_cea(info, b);
+    }
+    return 0;
+}
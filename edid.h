@@ -0,0 +1,43 @@
+#include <stdbool.h>
+#include <inttypes.h>
+
+#define EDID_MAX_MODES 64
+
+struct edid_mode {
+    drmModeModeInfo mode;
+    const char      *source;    /* "dtd", "cea-dtd" or "cea-vic" */
+    int             vic;
+    bool            preferred;
+};
+
+struct edid_info {
+    char             vendor[4];
+    uint16_t         product;
+    uint32_t         serial;
+    int              week, year;
+    int              version, revision;
+    int              width_cm, height_cm;
+    char             name[16];
+    char             serial_str[16];
+    int              extensions;
+
+    /* range limits descriptor */
+    bool             has_range;
+    int              min_vfreq, max_vfreq;   /* Hz  */
+    int              min_hfreq, max_hfreq;   /* kHz */
+    int              max_clock;              /* MHz */
+
+    /* cea-861 extension block */
+    bool             has_cea;
+    int              cea_revision;
+    bool             cea_underscan;
+    bool             cea_audio;
+    bool             cea_ycbcr444;
+    bool             cea_ycbcr422;
+    bool             cea_hdmi;
+
+    int              count_modes;
+    struct edid_mode modes[EDID_MAX_MODES];
+};
+
+int edid_parse(struct edid_info *info, const uint8_t *data, size_t len);
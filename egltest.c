@@ -2,11 +2,19 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <string.h>
 #include <inttypes.h>
 #include <getopt.h>
 #include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/dma-buf.h>
+#include <linux/udmabuf.h>
 
 #include <gbm.h>
 #include <epoxy/gl.h>
@@ -14,6 +22,7 @@
 
 #include <xf86drm.h>
 #include <xf86drmMode.h>
+#include <libdrm/drm_fourcc.h>
 
 #include <cairo.h>
 #include <pixman.h>
@@ -66,6 +75,854 @@ static void egl_draw(void)
     glFlush();
 }
 
+/* ------------------------------------------------------------------ */
+/* benchmark scenes                                                   */
+
+#define BENCH_SECS   3
+#define FILL_LAYERS  8
+#define TEX_SIZE     1024
+#define GRID_SIZE    64      /* GRID_SIZE^2 draw calls per frame */
+
+struct egl_scene {
+    const char *name;
+    const char *desc;
+    int        gl_version;   /* minimum, as reported by epoxy */
+    bool       (*init)(void);   /* false: not supported */
+    void       (*draw)(int frame);
+    void       (*fini)(void);
+};
+
+static uint32_t width, height;    /* output mode or headless fbo size */
+static GLuint tex, pbo, vbo;
+static uint32_t *texdata;
+
+static double egl_time(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* fill rate: blended full screen layers */
+static void scene_fill_draw(int frame)
+{
+    int i;
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    for (i = 0; i < FILL_LAYERS; i++) {
+        glColor4f(i & 1, (i >> 1) & 1, (frame & 0xff) / 255.0, 0.5);
+        glRectf(-1, -1, 1, 1);
+    }
+    glDisable(GL_BLEND);
+}
+
+/* texture upload: new texture content each frame, drawn as quad */
+static bool scene_tex_init(void)
+{
+    texdata = malloc(TEX_SIZE * TEX_SIZE * 4);
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, TEX_SIZE, TEX_SIZE, 0,
+                 GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+    return true;
+}
+
+static void scene_tex_fini(void)
+{
+    glDeleteTextures(1, &tex);
+    if (pbo)
+        glDeleteBuffers(1, &pbo);
+    pbo = 0;
+    free(texdata);
+}
+
+/* stride in pixels */
+static void scene_tex_fill(uint32_t *dst, uint32_t stride, int frame)
+{
+    int x, y;
+
+    for (y = 0; y < TEX_SIZE; y++)
+        for (x = 0; x < TEX_SIZE; x++)
+            dst[y * stride + x] =
+                0xff000000 | ((((x + frame) ^ y) & 0xff) * 0x010101);
+}
+
+static void scene_tex_quad(void)
+{
+    glEnable(GL_TEXTURE_2D);
+    glColor3f(1, 1, 1);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 0); glVertex2f(-1, -1);
+    glTexCoord2f(1, 0); glVertex2f( 1, -1);
+    glTexCoord2f(1, 1); glVertex2f( 1,  1);
+    glTexCoord2f(0, 1); glVertex2f(-1,  1);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+}
+
+static void scene_upload_draw(int frame)
+{
+    scene_tex_fill(texdata, TEX_SIZE, frame);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TEX_SIZE, TEX_SIZE,
+                    GL_BGRA, GL_UNSIGNED_BYTE, texdata);
+    scene_tex_quad();
+}
+
+static bool scene_pbo_init(void)
+{
+    scene_tex_init();
+    glGenBuffers(1, &pbo);
+    return true;
+}
+
+static void scene_pbo_draw(int frame)
+{
+    void *ptr;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    /* orphan the old storage, so we don't wait for the last upload */
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, TEX_SIZE * TEX_SIZE * 4,
+                 NULL, GL_STREAM_DRAW);
+    ptr = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+    if (ptr) {
+        scene_tex_fill(ptr, TEX_SIZE, frame);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TEX_SIZE, TEX_SIZE,
+                    GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    scene_tex_quad();
+}
+
+/* many small draw calls, vertices in a vbo */
+static bool scene_vbo_init(void)
+{
+    GLfloat *v, *p, step = 2.0 / GRID_SIZE;
+    int x, y;
+
+    v = p = malloc(GRID_SIZE * GRID_SIZE * 4 * 2 * sizeof(GLfloat));
+    for (y = 0; y < GRID_SIZE; y++) {
+        for (x = 0; x < GRID_SIZE; x++) {
+            *p++ = -1 + x * step;        *p++ = -1 + y * step;
+            *p++ = -1 + (x + 1) * step;  *p++ = -1 + y * step;
+            *p++ = -1 + (x + 1) * step;  *p++ = -1 + (y + 1) * step;
+            *p++ = -1 + x * step;        *p++ = -1 + (y + 1) * step;
+        }
+    }
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER,
+                 GRID_SIZE * GRID_SIZE * 4 * 2 * sizeof(GLfloat),
+                 v, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    free(v);
+    return true;
+}
+
+static void scene_vbo_draw(int frame)
+{
+    int i;
+
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, NULL);
+    for (i = 0; i < GRID_SIZE * GRID_SIZE; i++) {
+        glColor3ub(i * 7 + frame, i * 13, i * 29);
+        glDrawArrays(GL_TRIANGLE_FAN, i * 4, 4);
+    }
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void scene_vbo_fini(void)
+{
+    glDeleteBuffers(1, &vbo);
+}
+
+/* ------------------------------------------------------------------ */
+/* dma-buf import (EGL_EXT_image_dma_buf_import)                      */
+
+struct egl_dmabuf {
+    int          fd;       /* dma-buf */
+    uint32_t     stride;   /* bytes */
+    size_t       size;
+    uint32_t     *ptr;     /* cpu mapping */
+    EGLImageKHR  image;
+};
+
+static const char *dmabuf_source = "dumb";
+static struct egl_dmabuf dmabuf;
+
+static void dmabuf_sync(int fd, uint64_t flags)
+{
+    struct dma_buf_sync sync = { .flags = flags };
+
+    while (ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync) < 0 &&
+           (errno == EINTR || errno == EAGAIN))
+        ;
+}
+
+static bool dmabuf_from_dumb(int fd, struct egl_dmabuf *d,
+                             uint32_t width, uint32_t height)
+{
+    struct drm_mode_create_dumb creq = {
+        .width  = width,
+        .height = height,
+        .bpp    = 32,
+    };
+    struct drm_mode_map_dumb mreq = {};
+    struct drm_mode_destroy_dumb dreq = {};
+    void *ptr = MAP_FAILED;
+
+    if (drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0)
+        return false;
+    mreq.handle = creq.handle;
+    if (drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq) == 0)
+        ptr = mmap(NULL, creq.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, mreq.offset);
+    if (ptr != MAP_FAILED &&
+        drmPrimeHandleToFD(fd, creq.handle, DRM_CLOEXEC | DRM_RDWR,
+                           &d->fd) < 0) {
+        munmap(ptr, creq.size);
+        ptr = MAP_FAILED;
+    }
+
+    /* mapping and dma-buf keep the buffer alive */
+    dreq.handle = creq.handle;
+    drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+    if (ptr == MAP_FAILED)
+        return false;
+    d->ptr = ptr;
+    d->size = creq.size;
+    d->stride = creq.pitch;
+    return true;
+}
+
+static bool dmabuf_from_udmabuf(struct egl_dmabuf *d,
+                                uint32_t width, uint32_t height)
+{
+    struct udmabuf_create create = {};
+    long pagesize = sysconf(_SC_PAGESIZE);
+    int memfd, dev;
+    void *ptr;
+
+    d->stride = width * 4;
+    d->size = (d->stride * height + pagesize - 1) & ~(pagesize - 1);
+
+    memfd = memfd_create("egltest", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0)
+        return false;
+    if (ftruncate(memfd, d->size) < 0 ||
+        fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0)
+        goto err;
+
+    dev = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+    if (dev < 0)
+        goto err;
+    create.memfd = memfd;
+    create.flags = UDMABUF_FLAGS_CLOEXEC;
+    create.size = d->size;
+    d->fd = ioctl(dev, UDMABUF_CREATE, &create);
+    close(dev);
+    if (d->fd < 0)
+        goto err;
+
+    ptr = mmap(NULL, d->size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (ptr == MAP_FAILED) {
+        close(d->fd);
+        goto err;
+    }
+    d->ptr = ptr;
+    close(memfd);
+    return true;
+
+err:
+    close(memfd);
+    return false;
+}
+
+static bool dmabuf_create(struct egl_dmabuf *d, uint32_t width, uint32_t height)
+{
+    bool ok;
+    int fd;
+
+    memset(d, 0, sizeof(*d));
+    if (strcmp(dmabuf_source, "dumb") == 0) {
+        return dmabuf_from_dumb(drm_fd, d, width, height);
+    } else if (strcmp(dmabuf_source, "vgem") == 0) {
+        fd = drm_init_vgem();
+        ok = dmabuf_from_dumb(fd, d, width, height);
+        close(fd);
+        return ok;
+    } else if (strcmp(dmabuf_source, "udmabuf") == 0) {
+        return dmabuf_from_udmabuf(d, width, height);
+    }
+    fprintf(stderr, "unknown dma-buf source: %s\n", dmabuf_source);
+    exit(1);
+}
+
+static bool dmabuf_import(struct egl_dmabuf *d, uint32_t width, uint32_t height)
+{
+    EGLDisplay dpy = eglGetCurrentDisplay();
+    EGLint attrs[] = {
+        EGL_WIDTH,                     width,
+        EGL_HEIGHT,                    height,
+        EGL_LINUX_DRM_FOURCC_EXT,      DRM_FORMAT_XRGB8888,
+        EGL_DMA_BUF_PLANE0_FD_EXT,     d->fd,
+        EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
+        EGL_DMA_BUF_PLANE0_PITCH_EXT,  d->stride,
+        EGL_NONE,
+    };
+
+    if (!epoxy_has_egl_extension(dpy, "EGL_EXT_image_dma_buf_import") ||
+        !epoxy_has_gl_extension("GL_OES_EGL_image"))
+        return false;
+    d->image = eglCreateImageKHR(dpy, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT,
+                                 NULL, attrs);
+    return d->image != EGL_NO_IMAGE_KHR;
+}
+
+static void dmabuf_destroy(struct egl_dmabuf *d)
+{
+    if (d->image != EGL_NO_IMAGE_KHR)
+        eglDestroyImageKHR(eglGetCurrentDisplay(), d->image);
+    munmap(d->ptr, d->size);
+    close(d->fd);
+}
+
+/* zero copy: cpu renders into the dma-buf, gl textures from it */
+static bool scene_dmabuf_init(void)
+{
+    if (!dmabuf_create(&dmabuf, TEX_SIZE, TEX_SIZE))
+        return false;
+    if (!dmabuf_import(&dmabuf, TEX_SIZE, TEX_SIZE)) {
+        dmabuf_destroy(&dmabuf);
+        return false;
+    }
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, dmabuf.image);
+    return true;
+}
+
+static void scene_dmabuf_draw(int frame)
+{
+    /* waits until gl is done sampling the previous frame */
+    dmabuf_sync(dmabuf.fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE);
+    scene_tex_fill(dmabuf.ptr, dmabuf.stride / 4, frame);
+    dmabuf_sync(dmabuf.fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    scene_tex_quad();
+}
+
+static void scene_dmabuf_fini(void)
+{
+    glDeleteTextures(1, &tex);
+    dmabuf_destroy(&dmabuf);
+}
+
+static void egl_dmabuf_result(const char *name, bool ok)
+{
+    fprintf(stdout, "    %-24s: %s\n", name, ok ? "OK" : "FAILED");
+}
+
+/*
+ * Check both directions: gl renders into the dma-buf (fbo), cpu
+ * reads it back; cpu writes, gl textures from it (shown on screen).
+ */
+static bool egl_dmabuf_test(void)
+{
+    GLint prev_fbo;
+    GLuint fbo;
+    bool ok, pass;
+
+    fprintf(stdout, "dma-buf import test (%s, %dx%d)\n",
+            dmabuf_source, TEX_SIZE, TEX_SIZE);
+    ok = dmabuf_create(&dmabuf, TEX_SIZE, TEX_SIZE);
+    egl_dmabuf_result("create dma-buf", ok);
+    if (!ok)
+        return false;
+    ok = dmabuf_import(&dmabuf, TEX_SIZE, TEX_SIZE);
+    egl_dmabuf_result("egl image import", ok);
+    if (!ok) {
+        dmabuf_destroy(&dmabuf);
+        return false;
+    }
+
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, dmabuf.image);
+    pass = (glGetError() == GL_NO_ERROR);
+    egl_dmabuf_result("bind texture", pass);
+
+    /* gpu -> cpu */
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fbo);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, tex, 0);
+    ok = (glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+          GL_FRAMEBUFFER_COMPLETE);
+    egl_dmabuf_result("render target (fbo)", ok);
+    if (ok) {
+        glViewport(0, 0, TEX_SIZE, TEX_SIZE);
+        glClearColor(0.0, 1.0, 0.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glFinish();
+        dmabuf_sync(dmabuf.fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
+        ok = ((dmabuf.ptr[0] & 0xffffff) == 0x00ff00 &&
+              (dmabuf.ptr[(TEX_SIZE - 1) * dmabuf.stride / 4 + TEX_SIZE - 1]
+               & 0xffffff) == 0x00ff00);
+        dmabuf_sync(dmabuf.fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+        egl_dmabuf_result("cpu sees gl rendering", ok);
+    }
+    pass = pass && ok;
+    glBindFramebuffer(GL_FRAMEBUFFER, prev_fbo);
+    glDeleteFramebuffers(1, &fbo);
+
+    /* cpu -> gpu */
+    glViewport(0, 0, width, height);
+    glClearColor(0.2, 0.2, 0.2, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    scene_dmabuf_draw(0);
+    drm_egl_flush_display();
+
+    glDeleteTextures(1, &tex);
+    dmabuf_destroy(&dmabuf);
+    return pass;
+}
+
+static const struct egl_scene scenes[] = {
+    {
+        .name       = "fill",
+        .desc       = "8 blended full screen layers",
+        .gl_version = 10,
+        .draw       = scene_fill_draw,
+    },{
+        .name       = "upload",
+        .desc       = "1024x1024 glTexSubImage2D",
+        .gl_version = 11,
+        .init       = scene_tex_init,
+        .draw       = scene_upload_draw,
+        .fini       = scene_tex_fini,
+    },{
+        .name       = "upload-pbo",
+        .desc       = "1024x1024 glTexSubImage2D via pbo",
+        .gl_version = 21,
+        .init       = scene_pbo_init,
+        .draw       = scene_pbo_draw,
+        .fini       = scene_tex_fini,
+    },{
+        .name       = "drawcalls",
+        .desc       = "4096 glDrawArrays calls, vbo",
+        .gl_version = 15,
+        .init       = scene_vbo_init,
+        .draw       = scene_vbo_draw,
+        .fini       = scene_vbo_fini,
+    },{
+        .name       = "dmabuf",
+        .desc       = "1024x1024 cpu rendered, dma-buf imported",
+        .gl_version = 11,
+        .init       = scene_dmabuf_init,
+        .draw       = scene_dmabuf_draw,
+        .fini       = scene_dmabuf_fini,
+    }
+};
+
+static void egl_bench_scene(const struct egl_scene *scene)
+{
+    double start, now, cpu;
+    int frames = 0;
+
+    if (epoxy_gl_version() < scene->gl_version) {
+        fprintf(stdout, "%-12s  %10s  %14s  (needs gl %d.%d)\n",
+                scene->name, "-", "-",
+                scene->gl_version / 10, scene->gl_version % 10);
+        return;
+    }
+    if (scene->init && !scene->init()) {
+        fprintf(stdout, "%-12s  %10s  %14s  (not supported)\n",
+                scene->name, "-", "-");
+        return;
+    }
+
+    /* warm up, not measured */
+    scene->draw(frames++);
+    drm_egl_flush_display();
+
+    start = egl_time(CLOCK_MONOTONIC);
+    cpu = egl_time(CLOCK_PROCESS_CPUTIME_ID);
+    do {
+        scene->draw(frames++);
+        drm_egl_flush_display();
+        now = egl_time(CLOCK_MONOTONIC);
+    } while (now - start < BENCH_SECS);
+    cpu = egl_time(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+    frames--;
+
+    fprintf(stdout, "%-12s  %10.1f  %14.2f  (%s)\n",
+            scene->name, frames / (now - start), cpu * 1000 / frames,
+            scene->desc);
+    if (scene->fini)
+        scene->fini();
+}
+
+static void egl_bench(void)
+{
+    int i;
+
+    glViewport(0, 0, width, height);
+    fprintf(stdout, "%dx%d, %s\n", width, height,
+            glGetString(GL_RENDERER));
+    fprintf(stdout, "%-12s  %10s  %14s\n", "scene", "fps", "cpu ms/frame");
+    for (i = 0; i < sizeof(scenes)/sizeof(scenes[0]); i++)
+        egl_bench_scene(scenes + i);
+}
+
+/* ------------------------------------------------------------------ */
+/* readback verification                                              */
+
+/*
+ * Each frame is read back into a pixel buffer object and fenced, so
+ * glReadPixels returns right away and the render loop keeps going.
+ * Once the fence signals the pbo is mapped and handed to the hash
+ * thread, which compares it against the expected frame.  The pbo is
+ * unmapped and reused when the hash thread is done with it.
+ *
+ * The readback time is measured on the gpu, with timestamp queries
+ * around glReadPixels.  Fences are only polled once per frame, after
+ * the (page flip) flush, so cpu side fence timing would mostly show
+ * the display refresh.
+ */
+
+#define VERIFY_FRAMES  300
+#define VERIFY_SLOTS   4
+
+enum verify_state {
+    SLOT_FREE = 0,
+    SLOT_FENCED,    /* readback queued, waiting for the fence */
+    SLOT_HASHING,   /* mapped, owned by the hash thread       */
+    SLOT_DONE,      /* hashed, needs unmap                    */
+};
+
+struct verify_slot {
+    enum verify_state state;
+    GLuint            pbo;
+    GLsync            fence;
+    GLuint            query[2];  /* GL_TIMESTAMP before/after readback */
+    int               frame;
+    const uint32_t    *ptr;
+};
+
+static struct verify_slot vslots[VERIFY_SLOTS];
+static pthread_mutex_t vlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t vcond = PTHREAD_COND_INITIALIZER;
+static uint32_t vwidth, vheight;
+static bool vquit, vtimer;
+
+/* results */
+static int vframes, vmismatch, vfirst = -1;
+static double vlat_min = 1e9, vlat_max, vlat_sum;
+
+/*
+ * Frame content: background plus a moving box, both done with
+ * (scissored) clears so the result is exact on any implementation.
+ */
+static uint32_t verify_bg(int frame)
+{
+    return ((frame * 37) & 0xff) << 16 | ((frame * 59) & 0xff) << 8 | 0x40;
+}
+
+static uint32_t verify_fg(int frame)
+{
+    return verify_bg(frame) ^ 0xffffff;
+}
+
+static void verify_box(int frame, int *x, int *y, int *w, int *h)
+{
+    *w = vwidth / 4;
+    *h = vheight / 4;
+    *x = (frame * 7) % (vwidth - *w);
+    *y = (frame * 5) % (vheight - *h);
+}
+
+static void verify_clear(uint32_t color)
+{
+    glClearColor(((color >> 16) & 0xff) / 255.0,
+                 ((color >>  8) & 0xff) / 255.0,
+                 ((color >>  0) & 0xff) / 255.0, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+static void verify_draw(int frame)
+{
+    int x, y, w, h;
+
+    verify_clear(verify_bg(frame));
+    verify_box(frame, &x, &y, &w, &h);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x, y, w, h);
+    verify_clear(verify_fg(frame));
+    glDisable(GL_SCISSOR_TEST);
+}
+
+/* fnv-1a, alpha ignored (xrgb scanout) */
+static uint32_t verify_hash_add(uint32_t hash, uint32_t pixel)
+{
+    int i;
+
+    for (i = 0; i < 3; i++, pixel >>= 8) {
+        hash ^= pixel & 0xff;
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+/* rows bottom-up, like glReadPixels */
+static uint32_t verify_hash(const uint32_t *ptr)
+{
+    uint32_t hash = 2166136261;
+    uint32_t x, y;
+
+    for (y = 0; y < vheight; y++)
+        for (x = 0; x < vwidth; x++)
+            hash = verify_hash_add(hash, ptr[y * vwidth + x]);
+    return hash;
+}
+
+static uint32_t verify_expected(int frame)
+{
+    uint32_t bg = verify_bg(frame), fg = verify_fg(frame);
+    uint32_t hash = 2166136261;
+    int x, y, bx, by, bw, bh;
+
+    verify_box(frame, &bx, &by, &bw, &bh);
+    for (y = 0; y < vheight; y++)
+        for (x = 0; x < vwidth; x++)
+            hash = verify_hash_add(hash,
+                                   (x >= bx && x < bx + bw &&
+                                    y >= by && y < by + bh) ? fg : bg);
+    return hash;
+}
+
+static void *verify_thread(void *arg)
+{
+    struct verify_slot *slot;
+    uint32_t got, exp;
+    int i;
+
+    pthread_mutex_lock(&vlock);
+    for (;;) {
+        slot = NULL;
+        for (i = 0; i < VERIFY_SLOTS; i++)
+            if (vslots[i].state == SLOT_HASHING &&
+                (!slot || vslots[i].frame < slot->frame))
+                slot = vslots + i;
+        if (!slot) {
+            if (vquit)
+                break;
+            pthread_cond_wait(&vcond, &vlock);
+            continue;
+        }
+        pthread_mutex_unlock(&vlock);
+
+        got = verify_hash(slot->ptr);
+        exp = verify_expected(slot->frame);
+
+        pthread_mutex_lock(&vlock);
+        if (got != exp) {
+            if (vfirst < 0)
+                fprintf(stderr, "frame %d: hash %08x, expected %08x\n",
+                        slot->frame, got, exp);
+            if (vfirst < 0 || vfirst > slot->frame)
+                vfirst = slot->frame;
+            vmismatch++;
+        }
+        vframes++;
+        slot->state = SLOT_DONE;
+        pthread_cond_broadcast(&vcond);
+    }
+    pthread_mutex_unlock(&vlock);
+    return NULL;
+}
+
+/* fence signaled (or waited for): map and pass to the hash thread */
+static void verify_map(struct verify_slot *slot)
+{
+    GLuint64 t0, t1;
+    double lat;
+
+    if (vtimer) {
+        /* issued before the fence, so the results are available */
+        glGetQueryObjectui64v(slot->query[0], GL_QUERY_RESULT, &t0);
+        glGetQueryObjectui64v(slot->query[1], GL_QUERY_RESULT, &t1);
+        lat = (t1 - t0) / 1e9;
+        if (vlat_min > lat)
+            vlat_min = lat;
+        if (vlat_max < lat)
+            vlat_max = lat;
+        vlat_sum += lat;
+    }
+
+    glDeleteSync(slot->fence);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+    slot->ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                 vwidth * vheight * 4, GL_MAP_READ_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!slot->ptr) {
+        fprintf(stderr, "glMapBufferRange failed (0x%x)\n", glGetError());
+        exit(1);
+    }
+
+    pthread_mutex_lock(&vlock);
+    slot->state = SLOT_HASHING;
+    pthread_cond_broadcast(&vcond);
+    pthread_mutex_unlock(&vlock);
+}
+
+static void verify_unmap(struct verify_slot *slot)
+{
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot->ptr = NULL;
+    slot->state = SLOT_FREE;
+}
+
+/* non-blocking: move slots along as far as possible */
+static void verify_poll(void)
+{
+    enum verify_state state;
+    int i;
+
+    for (i = 0; i < VERIFY_SLOTS; i++) {
+        pthread_mutex_lock(&vlock);
+        state = vslots[i].state;
+        pthread_mutex_unlock(&vlock);
+        if (state == SLOT_FENCED &&
+            glClientWaitSync(vslots[i].fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+            verify_map(vslots + i);
+        else if (state == SLOT_DONE)
+            verify_unmap(vslots + i);
+    }
+}
+
+/* blocking: wait until the slot can be reused */
+static void verify_reclaim(struct verify_slot *slot)
+{
+    if (slot->state == SLOT_FENCED) {
+        glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                         GL_TIMEOUT_IGNORED);
+        verify_map(slot);
+    }
+    pthread_mutex_lock(&vlock);
+    while (slot->state == SLOT_HASHING)
+        pthread_cond_wait(&vcond, &vlock);
+    pthread_mutex_unlock(&vlock);
+    if (slot->state == SLOT_DONE)
+        verify_unmap(slot);
+}
+
+static bool egl_verify(void)
+{
+    struct verify_slot *slot;
+    pthread_t thread;
+    double start, now;
+    int i, frame, rc;
+
+    if (epoxy_gl_version() < 32 && !epoxy_has_gl_extension("GL_ARB_sync")) {
+        fprintf(stderr, "verify: needs gl 3.2 or GL_ARB_sync\n");
+        return false;
+    }
+
+    vtimer = (epoxy_gl_version() >= 33 ||
+              epoxy_has_gl_extension("GL_ARB_timer_query"));
+    vwidth = width;
+    vheight = height;
+    glViewport(0, 0, vwidth, vheight);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    for (i = 0; i < VERIFY_SLOTS; i++) {
+        glGenBuffers(1, &vslots[i].pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, vslots[i].pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, vwidth * vheight * 4, NULL,
+                     GL_STREAM_READ);
+        if (vtimer)
+            glGenQueries(2, vslots[i].query);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    rc = pthread_create(&thread, NULL, verify_thread, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(rc));
+        for (i = 0; i < VERIFY_SLOTS; i++) {
+            glDeleteBuffers(1, &vslots[i].pbo);
+            if (vtimer)
+                glDeleteQueries(2, vslots[i].query);
+        }
+        return false;
+    }
+
+    start = egl_time(CLOCK_MONOTONIC);
+    for (frame = 0; frame < VERIFY_FRAMES; frame++) {
+        slot = vslots + frame % VERIFY_SLOTS;
+        verify_reclaim(slot);
+
+        verify_draw(frame);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+        if (vtimer)
+            glQueryCounter(slot->query[0], GL_TIMESTAMP);
+        glReadPixels(0, 0, vwidth, vheight, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+        if (vtimer)
+            glQueryCounter(slot->query[1], GL_TIMESTAMP);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot->frame = frame;
+        slot->state = SLOT_FENCED;
+
+        drm_egl_flush_display();
+        verify_poll();
+    }
+    now = egl_time(CLOCK_MONOTONIC);
+
+    for (i = 0; i < VERIFY_SLOTS; i++)
+        verify_reclaim(vslots + i);
+    pthread_mutex_lock(&vlock);
+    vquit = true;
+    pthread_cond_broadcast(&vcond);
+    pthread_mutex_unlock(&vlock);
+    pthread_join(thread, NULL);
+    for (i = 0; i < VERIFY_SLOTS; i++) {
+        glDeleteBuffers(1, &vslots[i].pbo);
+        if (vtimer)
+            glDeleteQueries(2, vslots[i].query);
+    }
+
+    fprintf(stdout, "%dx%d, %s\n", vwidth, vheight,
+            glGetString(GL_RENDERER));
+    fprintf(stdout, "frames     : %d verified, %d mismatch, %.1f fps\n",
+            vframes, vmismatch, VERIFY_FRAMES / (now - start));
+    if (vtimer)
+        fprintf(stdout, "readback   : %.3f min, %.3f avg, %.3f max "
+                "(ms, gpu timestamps)\n",
+                vlat_min * 1000, vlat_sum * 1000 / vframes, vlat_max * 1000);
+    else
+        fprintf(stdout, "readback   : not measured, "
+                "needs GL_ARB_timer_query\n");
+    if (vmismatch)
+        fprintf(stdout, "first bad  : frame %d\n", vfirst);
+    return vframes == VERIFY_FRAMES && vmismatch == 0;
+}
+
 /* ------------------------------------------------------------------ */
 
 static void usage(FILE *fp)
@@ -79,15 +936,30 @@ static void usage(FILE *fp)
             "  -a | --autotest        autotest mode\n"
             "  -i | --info            print device info\n"
             "  -x | --exts            print extensions\n"
+            "  -b | --bench           run benchmark scenes (fill rate,\n"
+            "                         texture upload, draw calls, dma-buf)\n"
+            "  -v | --verify          render frames, verify them using\n"
+            "                         async (pbo + fence) readback\n"
+            "  -d | --dmabuf <src>    test dma-buf import into egl, source\n"
+            "                         is dumb (default), vgem or udmabuf\n"
             "  -c | --card  <nr>      pick card\n"
+            "  -r | --render <nr>     headless, use render node <nr>\n"
+            "       --surfaceless     headless, use the surfaceless platform\n"
+            "       --size <w>x<h>    framebuffer size when headless\n"
+            "                         (default: 1024x768)\n"
             "  -s | --sleep <secs>    set sleep time (default: 60)\n"
             "       --lease <output>  get a drm lease for output\n"
+            "\n"
+            "Headless modes need no kms device and no connected output,\n"
+            "rendering goes to an offscreen framebuffer.\n"
             "\n");
 }
 
 enum {
     OPT_LONG_LEASE,
     OPT_LONG_COMP_BASH,
+    OPT_LONG_SURFACELESS,
+    OPT_LONG_SIZE,
 };
 
 static struct option long_opts[] = {
@@ -108,16 +980,36 @@ static struct option long_opts[] = {
         .name    = "exts",
         .has_arg = false,
         .val     = 'x',
+    },{
+        .name    = "bench",
+        .has_arg = false,
+        .val     = 'b',
+    },{
+        .name    = "verify",
+        .has_arg = false,
+        .val     = 'v',
     },{
         .name    = "complete-bash",
         .has_arg = false,
         .val     = OPT_LONG_COMP_BASH,
     },{
+        .name    = "surfaceless",
+        .has_arg = false,
+        .val     = OPT_LONG_SURFACELESS,
+    },{
 
         /* --- with argument --- */
         .name    = "card",
         .has_arg = true,
         .val     = 'c',
+    },{
+        .name    = "render",
+        .has_arg = true,
+        .val     = 'r',
+    },{
+        .name    = "size",
+        .has_arg = true,
+        .val     = OPT_LONG_SIZE,
     },{
         .name    = "sleep",
         .has_arg = true,
@@ -126,6 +1018,10 @@ static struct option long_opts[] = {
         .name    = "lease",
         .has_arg = true,
         .val     = OPT_LONG_LEASE,
+    },{
+        .name    = "dmabuf",
+        .has_arg = true,
+        .val     = 'd',
     },{
         /* end of list */
     }
@@ -138,19 +1034,40 @@ int main(int argc, char **argv)
     int lease_fd = -1;
     char *output = NULL;
     char *modename = NULL;
+    char rendernode[64];
+    bool headless = false;
+    int render = -1;
     bool printinfo = false;
     bool printext = false;
     bool autotest = false;
+    bool bench = false;
+    bool dmabuf_test = false;
+    bool verify = false;
+    int rc = 0;
     int c;
 
     for (;;) {
-        c = getopt_long(argc, argv, "haixc:s:", long_opts, NULL);
+        c = getopt_long(argc, argv, "haixbvc:r:s:d:", long_opts, NULL);
         if (c == -1)
             break;
         switch (c) {
         case 'c':
             card = atoi(optarg);
             break;
+        case 'r':
+            render = atoi(optarg);
+            headless = true;
+            break;
+        case OPT_LONG_SURFACELESS:
+            headless = true;
+            break;
+        case OPT_LONG_SIZE:
+            if (sscanf(optarg, "%ux%u", &width, &height) != 2 ||
+                !width || !height) {
+                fprintf(stderr, "invalid size: %s\n", optarg);
+                exit(1);
+            }
+            break;
         case 's':
             secs = atoi(optarg);
             break;
@@ -160,6 +1077,16 @@ int main(int argc, char **argv)
         case 'x':
             printext = true;
             break;
+        case 'b':
+            bench = true;
+            break;
+        case 'v':
+            verify = true;
+            break;
+        case 'd':
+            dmabuf_source = optarg;
+            dmabuf_test = true;
+            break;
         case 'a':
             autotest = true;
             break;
@@ -179,8 +1106,22 @@ int main(int argc, char **argv)
     }
 
     logind_init();
-    drm_init_dev(card, output, modename, false, lease_fd);
-    drm_setup_egl();
+    if (headless) {
+        if (!width) {
+            width = 1024;
+            height = 768;
+        }
+        snprintf(rendernode, sizeof(rendernode),
+                 "/dev/dri/renderD%d", render + 128);
+        if (drm_setup_egl_headless(render >= 0 ? rendernode : NULL,
+                                   width, height) < 0)
+            exit(1);
+    } else {
+        drm_init_dev(card, output, modename, false, lease_fd);
+        drm_setup_egl();
+        width = drm_mode->hdisplay;
+        height = drm_mode->vdisplay;
+    }
 
     if (printinfo)
         egl_print_info();
@@ -189,11 +1130,28 @@ int main(int argc, char **argv)
     if (printinfo || printext)
         goto done;
 
-    egl_draw();
-    drm_egl_flush_display();
+    if (bench) {
+        egl_bench();
+        goto done;
+    }
+    if (verify) {
+        rc = egl_verify() ? 0 : 1;
+        goto done;
+    }
+    if (dmabuf_test) {
+        if (!egl_dmabuf_test()) {
+            rc = 1;
+            goto done;
+        }
+    } else {
+        egl_draw();
+        drm_egl_flush_display();
+    }
 
     if (autotest)
         fprintf(stdout, "---ok---\n");
+    if (headless)
+        goto done;
 
     tty_raw();
     kbd_wait(secs);
@@ -203,5 +1161,5 @@ int main(int argc, char **argv)
 done:
     drm_fini_dev();
     logind_fini();
-    return 0;
+    return rc;
 }
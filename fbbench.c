@@ -0,0 +1,420 @@
+/*
+ * compare fbdev and drm dumb buffer throughput on the same device
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include <cairo.h>
+#include <pixman.h>
+
+#include "fbtools.h"
+#include "drmtools.h"
+#include "logind.h"
+#include "complete.h"
+
+/* ------------------------------------------------------------------ */
+
+#define FLUSH_LOOPS    10
+#define FLUSH_TIMEOUT  1.0
+
+struct bench {
+    const char *name;
+    uint8_t    *mem;
+    size_t     len;
+    void       (*flush)(void);
+
+    /* results */
+    double     fill;      /* MB/s */
+    double     copy;      /* MB/s */
+    double     update;    /* ms   */
+    double     update_max;
+    double     delay;     /* ms, deferred flush, < 0 if unknown */
+};
+
+static struct bench fbdev_bench;
+static struct bench dumb_bench;
+static double bench_secs = 1.0;
+
+/* scanout buffer of the fbdev emulation, for deferred flush timing */
+static uint8_t *scanout_mem;
+static size_t scanout_len;
+
+/* dumb buffer */
+static struct drm_mode_create_dumb creq;
+
+static double bench_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ------------------------------------------------------------------ */
+
+static void bench_run(struct bench *b)
+{
+    double start, now, last;
+    uint8_t *src;
+    int frames;
+
+    src = malloc(b->len);
+    memset(src, 0x55, b->len);
+
+    /* fill */
+    frames = 0;
+    start = bench_time();
+    do {
+        fb_fill(b->mem, (frames & 1) ? 0xffffffff : 0, b->len);
+        frames++;
+        now = bench_time();
+    } while (now - start < bench_secs);
+    b->fill = b->len * frames / (now - start) / (1024 * 1024);
+
+    /* copy */
+    frames = 0;
+    start = bench_time();
+    do {
+        fb_copy(b->mem, src, b->len);
+        frames++;
+        now = bench_time();
+    } while (now - start < bench_secs);
+    b->copy = b->len * frames / (now - start) / (1024 * 1024);
+
+    /* full frame update: copy + flush to the display */
+    frames = 0;
+    start = last = bench_time();
+    do {
+        src[0] = frames;
+        fb_copy(b->mem, src, b->len);
+        if (b->flush)
+            b->flush();
+        frames++;
+        now = bench_time();
+        if (b->update_max < now - last)
+            b->update_max = now - last;
+        last = now;
+    } while (now - start < bench_secs);
+    b->update = (now - start) * 1000 / frames;
+    b->update_max *= 1000;
+
+    free(src);
+}
+
+/* ------------------------------------------------------------------ */
+/* fbdev                                                              */
+
+/*
+ * drm fbdev emulation often renders into a shadow buffer and copies
+ * to the scanout buffer from a (deferred I/O) worker.  Map the buffer
+ * currently shown by the crtc and measure how long it takes until a
+ * write to /dev/fb shows up there.
+ */
+static bool fbdev_map_scanout(void)
+{
+    struct drm_mode_map_dumb mreq;
+    struct drm_gem_close creq;
+    drmModeCrtc *crtc;
+    drmModeFBPtr fb;
+    void *mem;
+
+    crtc = drmModeGetCrtc(drm_fd, drm_enc->crtc_id);
+    if (!crtc || !crtc->buffer_id)
+        return false;
+    fb = drmModeGetFB(drm_fd, crtc->buffer_id);
+    drmModeFreeCrtc(crtc);
+    if (!fb)
+        return false;
+    if (!fb->handle || fb->pitch != fb_fix.line_length) {
+        drmModeFreeFB(fb);
+        return false;
+    }
+
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.handle = fb->handle;
+    scanout_len = (size_t)fb->pitch * fb->height;
+    mem = MAP_FAILED;
+    if (drmIoctl(drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq) == 0)
+        mem = mmap(NULL, scanout_len, PROT_READ, MAP_SHARED,
+                   drm_fd, mreq.offset);
+
+    /* drmModeGetFB() hands out a new handle reference, the mapping
+     * keeps the buffer alive */
+    memset(&creq, 0, sizeof(creq));
+    creq.handle = fb->handle;
+    drmIoctl(drm_fd, DRM_IOCTL_GEM_CLOSE, &creq);
+    drmModeFreeFB(fb);
+
+    if (mem == MAP_FAILED)
+        return false;
+    scanout_mem = mem;
+    return true;
+}
+
+static double fbdev_flush_delay(struct bench *b)
+{
+    static const uint32_t markers[] = { 0x00ff00ff, 0x0000ff00 };
+    volatile uint32_t *scanout = (uint32_t*)scanout_mem;
+    double start, now, total = 0;
+    int i;
+
+    if (!scanout_mem)
+        return -1;
+    for (i = 0; i < FLUSH_LOOPS; i++) {
+        *(volatile uint32_t*)b->mem = markers[i & 1];
+        start = bench_time();
+        do {
+            now = bench_time();
+            if (*scanout == markers[i & 1])
+                break;
+            usleep(100);
+        } while (now - start < FLUSH_TIMEOUT);
+        if (*scanout != markers[i & 1])
+            return -1;
+        total += now - start;
+    }
+    return total * 1000 / FLUSH_LOOPS;
+}
+
+static void fbdev_bench_run(int fbdev)
+{
+    struct bench *b = &fbdev_bench;
+    bool scanout;
+
+    fb_init(fbdev);
+    scanout = fbdev_map_scanout();
+
+    b->name = "fbdev";
+    b->mem  = fb_mem + fb_mem_offset;
+    b->len  = fb_fix.line_length * fb_var.yres;
+    bench_run(b);
+    b->delay = fbdev_flush_delay(b);
+
+    if (scanout)
+        munmap(scanout_mem, scanout_len);
+    fb_fini();
+}
+
+/* ------------------------------------------------------------------ */
+/* drm dumb buffer                                                    */
+
+static void dumb_flush(void)
+{
+    drmModeDirtyFB(drm_fd, fb_id, 0, 0);
+}
+
+static void dumb_bench_run(void)
+{
+    struct bench *b = &dumb_bench;
+    struct drm_mode_map_dumb mreq;
+    struct drm_mode_destroy_dumb dreq;
+    void *mem;
+    int rc;
+
+    memset(&creq, 0, sizeof(creq));
+    creq.width = drm_mode->hdisplay;
+    creq.height = drm_mode->vdisplay;
+    creq.bpp = 32;
+    rc = drmIoctl(drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq);
+    if (rc < 0) {
+        fprintf(stderr, "DRM_IOCTL_MODE_CREATE_DUMB: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.handle = creq.handle;
+    rc = drmIoctl(drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq);
+    if (rc < 0) {
+        fprintf(stderr, "DRM_IOCTL_MODE_MAP_DUMB: %s\n", strerror(errno));
+        exit(1);
+    }
+    mem = mmap(0, creq.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               drm_fd, mreq.offset);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "framebuffer mmap: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    rc = drmModeAddFB(drm_fd, creq.width, creq.height, 24, 32,
+                      creq.pitch, creq.handle, &fb_id);
+    if (rc < 0) {
+        fprintf(stderr, "drmModeAddFB() failed\n");
+        exit(1);
+    }
+    drm_show_fb();
+
+    b->name  = "drm dumb";
+    b->mem   = mem;
+    b->len   = (size_t)creq.pitch * creq.height;
+    b->flush = dumb_flush;
+    b->delay = -1;
+    bench_run(b);
+
+    drm_fini_dev();
+    drmModeRmFB(drm_fd, fb_id);
+    munmap(mem, creq.size);
+    dreq.handle = creq.handle;
+    drmIoctl(drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+}
+
+/* ------------------------------------------------------------------ */
+
+static void bench_print_hdr(void)
+{
+    fprintf(stdout, "%-10s  %9s  %9s  %9s  %9s  %9s\n",
+            "", "fill", "copy", "update", "update", "flush");
+    fprintf(stdout, "%-10s  %9s  %9s  %9s  %9s  %9s\n",
+            "", "MB/s", "MB/s", "avg ms", "max ms", "delay ms");
+}
+
+static void bench_print(struct bench *b)
+{
+    char delay[16];
+
+    if (b->delay < 0)
+        snprintf(delay, sizeof(delay), "-");
+    else
+        snprintf(delay, sizeof(delay), "%.2f", b->delay);
+    fprintf(stdout, "%-10s  %9.1f  %9.1f  %9.2f  %9.2f  %9s\n",
+            b->name, b->fill, b->copy, b->update, b->update_max, delay);
+}
+
+static void usage(FILE *fp)
+{
+    fprintf(fp,
+            "\n"
+            "usage: fbbench [ options ]\n"
+            "\n"
+            "options:\n"
+            "  -h | --help            print this\n"
+            "  -c | --card <nr>       pick drm card\n"
+            "  -f | --fbdev <nr>      pick framebuffer\n"
+            "  -o | --output <name>   pick output\n"
+            "  -s | --secs <secs>     run time per test (default: 1)\n"
+            "\n"
+            "Measures fill, copy and full frame update (copy + flush)\n"
+            "throughput via fbdev and via drm dumb buffer.  For drm fbdev\n"
+            "emulation the delay until fbdev writes reach the scanout\n"
+            "buffer is measured too.\n"
+            "\n");
+}
+
+enum {
+    OPT_LONG_COMP_BASH = 0x100,
+    OPT_LONG_COMP_CARD,
+    OPT_LONG_COMP_FBDEV,
+};
+
+static struct option long_opts[] = {
+    {
+        /* --- no argument --- */
+        .name    = "help",
+        .has_arg = false,
+        .val     = 'h',
+    },{
+        .name    = "complete-bash",
+        .has_arg = false,
+        .val     = OPT_LONG_COMP_BASH,
+    },{
+        .name    = "complete-card",
+        .has_arg = false,
+        .val     = OPT_LONG_COMP_CARD,
+    },{
+        .name    = "complete-fbdev",
+        .has_arg = false,
+        .val     = OPT_LONG_COMP_FBDEV,
+    },{
+
+        /* --- with argument --- */
+        .name    = "card",
+        .has_arg = true,
+        .val     = 'c',
+    },{
+        .name    = "fbdev",
+        .has_arg = true,
+        .val     = 'f',
+    },{
+        .name    = "output",
+        .has_arg = true,
+        .val     = 'o',
+    },{
+        .name    = "secs",
+        .has_arg = true,
+        .val     = 's',
+    },{
+        /* end of list */
+    }
+};
+
+int main(int argc, char **argv)
+{
+    int card = 0;
+    int fbdev = 0;
+    char *output = NULL;
+    int c;
+
+    for (;;) {
+        c = getopt_long(argc, argv, "hc:f:o:s:", long_opts, NULL);
+        if (c == -1)
+            break;
+        switch (c) {
+        case 'c':
+            card = atoi(optarg);
+            break;
+        case 'f':
+            fbdev = atoi(optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 's':
+            bench_secs = atof(optarg);
+            break;
+        case OPT_LONG_COMP_BASH:
+            complete_bash("fbbench", long_opts);
+            exit(0);
+        case OPT_LONG_COMP_CARD:
+            complete_device_nr("/dev/dri/card");
+            exit(0);
+        case OPT_LONG_COMP_FBDEV:
+            complete_device_nr("/dev/fb");
+            exit(0);
+        case 'h':
+            usage(stdout);
+            exit(0);
+        default:
+            usage(stderr);
+            exit(1);
+        }
+    }
+
+    logind_init();
+    drm_init_dev(card, output, NULL, true, -1);
+
+    fbdev_bench_run(fbdev);
+    dumb_bench_run();
+
+    fprintf(stdout, "%dx%d, fbdev %d bpp (%s), drm xrgb8888 (%s)\n",
+            drm_mode->hdisplay, drm_mode->vdisplay,
+            fb_var.bits_per_pixel, fb_fix.id, version->name);
+    fprintf(stdout, "fill/copy with %s\n", fb_fill_best()->name);
+    bench_print_hdr();
+    bench_print(&fbdev_bench);
+    bench_print(&dumb_bench);
+
+    logind_fini();
+    return 0;
+}
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <inttypes.h>
 #include <getopt.h>
+#include <time.h>
 
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -38,12 +39,14 @@ static void fb_draw(bool autotest)
     cairo_t *cr;
 
     snprintf(info1, sizeof(info1), "mode: %dx%d", fb_var.xres, fb_var.yres);
-    snprintf(info2, sizeof(info2), "%d bpp, rgba %d,%d,%d,%d",
+    snprintf(info2, sizeof(info2), "%d bpp, rgba %d,%d,%d,%d%s%s",
              fb_var.bits_per_pixel,
              fb_var.red.length,
              fb_var.green.length,
              fb_var.blue.length,
-             fb_var.transp.length);
+             fb_var.transp.length,
+             fb_convert_name ? ", converted to " : "",
+             fb_convert_name ? fb_convert_name    : "");
     snprintf(info3, sizeof(info3), "fb driver: %s", fb_fix.id);
 
     cr = cairo_create(cs);
@@ -58,6 +61,242 @@ static void fb_draw(bool autotest)
 
 /* ------------------------------------------------------------------ */
 
+static double fb_bench_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct {
+    bool dbuf;
+    bool vsync;
+    bool shadow;
+    long rows;
+    int frames;
+    int synced;     /* panned right after FBIO_WAITFORVSYNC */
+    double secs;
+    double max;
+} flip;
+
+static void fb_draw_bar(int frame)
+{
+    int w = fb_var.xres / 32;
+    int x = (frame * w / 4) % (fb_var.xres - w);
+    cairo_t *cr;
+
+    /* moving vertical bar, makes tearing visible */
+    cr = cairo_create(cs);
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_rectangle(cr, x, 0, w, fb_var.yres);
+    cairo_fill(cr);
+    cairo_destroy(cr);
+}
+
+static void fb_flip_loop(bool autotest, bool vsync, bool shadow, int secs)
+{
+    cairo_surface_t *surface[2];
+    double start, last, now;
+    int i, back;
+
+    /* shadow mode tracks the screen contents, single buffer only */
+    flip.shadow = shadow;
+    flip.dbuf = !shadow && fb_flip_init();
+    flip.vsync = vsync && flip.dbuf;
+    for (i = 0; i < fb_buffers; i++)
+        surface[i] = cairo_image_surface_create_for_data(shadow
+                                                         ? fb_shadow
+                                                         : fb_buffer(i),
+                                                         fb_format,
+                                                         fb_var.xres,
+                                                         fb_var.yres,
+                                                         shadow
+                                                         ? fb_shadow_stride
+                                                         : fb_fix.line_length);
+    back = fb_buffers - 1;
+
+    start = last = now = fb_bench_time();
+    do {
+        cs = surface[back];
+        fb_draw(autotest);
+        fb_draw_bar(flip.frames);
+        if (flip.shadow)
+            flip.rows += fb_shadow_flush(fb_buffer(0));
+        if (flip.dbuf && fb_flip(back, flip.vsync) < 0) {
+            if (flip.vsync) {
+                /* no FBIO_WAITFORVSYNC support, try without */
+                flip.vsync = false;
+            } else {
+                /* panning failed, fall back to single buffer */
+                flip.dbuf = false;
+                back = 0;
+            }
+            continue;
+        }
+        if (flip.dbuf) {
+            if (flip.vsync)
+                flip.synced++;
+            back ^= 1;
+        }
+        flip.frames++;
+        now = fb_bench_time();
+        if (flip.max < now - last)
+            flip.max = now - last;
+        last = now;
+    } while (now - start < secs);
+    flip.secs = now - start;
+
+    fb_flip(0, false);
+    for (i = 0; i < fb_buffers; i++)
+        cairo_surface_destroy(surface[i]);
+    cs = NULL;
+}
+
+static void fb_flip_print(bool vsync)
+{
+    double fps = flip.frames / flip.secs;
+
+    fprintf(stdout, "update rate, %dx%d, %d bpp, %s%s%s\n",
+            fb_var.xres, fb_var.yres, fb_var.bits_per_pixel,
+            flip.dbuf   ? "double buffered" : "single buffered",
+            flip.vsync  ? ", vsync"         : "",
+            flip.shadow ? ", shadow"        : "");
+    if (flip.shadow)
+        fprintf(stdout, "    (shadow buffer, page flipping not used)\n");
+    else if (!flip.dbuf)
+        fprintf(stdout, "    (panning not supported by fbdev driver)\n");
+    else if (vsync && !flip.vsync)
+        fprintf(stdout, "    (vsync not supported by fbdev driver)\n");
+    fprintf(stdout, "    frames      : %d in %.2f s\n", flip.frames, flip.secs);
+    fprintf(stdout, "    frame rate  : %.1f fps\n", fps);
+    fprintf(stdout, "    frame time  : %.2f ms avg, %.2f ms max\n",
+            flip.secs * 1000 / flip.frames, flip.max * 1000);
+    fprintf(stdout, "    tear-free   : %d frames, %.1f updates/s\n",
+            flip.synced, flip.synced / flip.secs);
+    if (flip.shadow)
+        fprintf(stdout, "    rows copied : %ld / %d per frame\n",
+                flip.rows / flip.frames, fb_var.yres);
+}
+
+/* ------------------------------------------------------------------ */
+
+#define BENCH_MAX   8
+#define BENCH_SECS  1.0
+
+static struct {
+    const struct fb_filler *filler;
+    int frames, cframes;
+    double secs, csecs;
+} bench[BENCH_MAX];
+
+/* render_test() cpu cost, without and with text cache */
+static struct {
+    int frames;
+    double secs;
+} rbench[2];
+
+static void fb_bench_render(void)
+{
+    cairo_surface_t *surface;
+    double start, now;
+    char info[32];
+    cairo_t *cr;
+    int n;
+
+    surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+                                         fb_var.xres, fb_var.yres);
+    for (n = 0; n < 2; n++) {
+        render_set_text_cache(n);
+        start = fb_bench_time();
+        do {
+            /* like update loops: one line changes every frame */
+            snprintf(info, sizeof(info), "frame #%d", rbench[n].frames);
+            cr = cairo_create(surface);
+            render_test(cr, fb_var.xres, fb_var.yres,
+                        "render benchmark", info, "fbtest");
+            cairo_destroy(cr);
+            rbench[n].frames++;
+            now = fb_bench_time();
+        } while (now - start < BENCH_SECS);
+        rbench[n].secs = now - start;
+    }
+    cairo_surface_destroy(surface);
+}
+
+static void fb_bench_run(void)
+{
+    static const uint32_t colors[] = {
+        0x00000000, 0xffffffff, 0x00ff0000, 0x0000ff00, 0x000000ff,
+    };
+    uint8_t *mem = fb_mem + fb_mem_offset;
+    size_t len = fb_fix.line_length * fb_var.yres;
+    const struct fb_filler *f;
+    double start, now;
+    uint8_t *src;
+    int n;
+
+    fb_bench_render();
+    src = malloc(len);
+    memset(src, 0x55, len);
+    for (n = 0; n < BENCH_MAX; n++) {
+        f = fb_fill_impl(n);
+        if (!f)
+            break;
+        bench[n].filler = f;
+        f->fill(mem, 0, len); /* warm up */
+        start = fb_bench_time();
+        do {
+            f->fill(mem, colors[bench[n].frames % 5], len);
+            bench[n].frames++;
+            now = fb_bench_time();
+        } while (now - start < BENCH_SECS);
+        bench[n].secs = now - start;
+
+        start = fb_bench_time();
+        do {
+            f->copy(mem, src, len);
+            bench[n].cframes++;
+            now = fb_bench_time();
+        } while (now - start < BENCH_SECS);
+        bench[n].csecs = now - start;
+    }
+    free(src);
+}
+
+static void fb_bench_print(void)
+{
+    size_t len = fb_fix.line_length * fb_var.yres;
+    int n;
+
+    fprintf(stdout, "fill bandwidth, %dx%d, %d bpp, %zd kB per frame\n",
+            fb_var.xres, fb_var.yres, fb_var.bits_per_pixel, len / 1024);
+    for (n = 0; n < BENCH_MAX && bench[n].filler; n++) {
+        fprintf(stdout, "    %-10s  %8.1f MB/s  %7.3f ms/frame%s\n",
+                bench[n].filler->name,
+                len * bench[n].frames / bench[n].secs / (1024 * 1024),
+                bench[n].secs * 1000 / bench[n].frames,
+                bench[n].filler == fb_fill_best() ? "  (default)" : "");
+    }
+    fprintf(stdout, "copy bandwidth, system memory to framebuffer\n");
+    for (n = 0; n < BENCH_MAX && bench[n].filler; n++) {
+        fprintf(stdout, "    %-10s  %8.1f MB/s  %7.3f ms/frame%s\n",
+                bench[n].filler->name,
+                len * bench[n].cframes / bench[n].csecs / (1024 * 1024),
+                bench[n].csecs * 1000 / bench[n].cframes,
+                bench[n].filler == fb_fill_best() ? "  (default)" : "");
+    }
+    fprintf(stdout, "test pattern rendering, system memory\n");
+    for (n = 0; n < 2; n++) {
+        fprintf(stdout, "    %-10s  %7.3f ms/frame%s\n",
+                n ? "text cache" : "no cache",
+                rbench[n].secs * 1000 / rbench[n].frames,
+                n ? "  (default)" : "");
+    }
+}
+
+/* ------------------------------------------------------------------ */
+
 static void usage(FILE *fp)
 {
     fprintf(fp,
@@ -70,6 +309,13 @@ static void usage(FILE *fp)
             "  -f | --fbdev <nr>    pick framebuffer\n"
             "  -s | --sleep <secs>  set sleep time (default: 60)\n"
             "  -i | --image <file>  load and display image <file>\n"
+            "  -b | --bench         benchmark fill and copy bandwidth,\n"
+            "                       test pattern rendering\n"
+            "  -d | --double-buffer animate for <secs> using page flips,\n"
+            "                       report update rate\n"
+            "  -v | --vsync         wait for vsync before flipping\n"
+            "  -S | --shadow        render into a shadow buffer in system\n"
+            "                       memory, copy changed rows to the fbdev\n"
             "\n");
 }
 
@@ -87,6 +333,22 @@ static struct option long_opts[] = {
         .name    = "autotest",
         .has_arg = false,
         .val     = 'a',
+    },{
+        .name    = "bench",
+        .has_arg = false,
+        .val     = 'b',
+    },{
+        .name    = "double-buffer",
+        .has_arg = false,
+        .val     = 'd',
+    },{
+        .name    = "vsync",
+        .has_arg = false,
+        .val     = 'v',
+    },{
+        .name    = "shadow",
+        .has_arg = false,
+        .val     = 'S',
     },{
         .name    = "complete-bash",
         .has_arg = false,
@@ -115,16 +377,33 @@ int main(int argc, char **argv)
     int framebuffer = 0;
     int secs = 60;
     bool autotest = false;
+    bool benchmark = false;
+    bool dbuf = false;
+    bool vsync = false;
+    bool shadow = false;
+    char *ifile = NULL;
     int c;
 
     for (;;) {
-        c = getopt_long(argc, argv, "has:i:f:", long_opts, NULL);
+        c = getopt_long(argc, argv, "habdvSs:i:f:", long_opts, NULL);
         if (c == -1)
             break;
         switch (c) {
         case 'a':
             autotest = true;
             break;
+        case 'b':
+            benchmark = true;
+            break;
+        case 'd':
+            dbuf = true;
+            break;
+        case 'v':
+            vsync = true;
+            break;
+        case 'S':
+            shadow = true;
+            break;
         case 'f':
             framebuffer = atoi(optarg);
             break;
@@ -132,7 +411,7 @@ int main(int argc, char **argv)
             secs = atoi(optarg);
             break;
         case 'i':
-            image = load_image(optarg);
+            ifile = optarg;
             break;
         case OPT_LONG_COMP_BASH:
             complete_bash("fbtest", long_opts);
@@ -151,12 +430,40 @@ int main(int argc, char **argv)
     logind_init();
 #endif
     fb_init(framebuffer);
-    cs = cairo_image_surface_create_for_data(fb_mem + fb_mem_offset,
+    if (ifile)
+        image = load_image(ifile, fb_var.xres, fb_var.yres);
+    if (benchmark) {
+        fb_bench_run();
+        fb_fini();
+        fb_bench_print();
+        return 0;
+    }
+    if (fb_convert_name) {
+        /* format cairo can't render to, needs conversion */
+        shadow = true;
+    }
+    if (shadow)
+        fb_shadow_init();
+    if (dbuf) {
+        fb_flip_loop(autotest, vsync, shadow, secs);
+        fb_fini();
+        fb_flip_print(vsync);
+        if (autotest)
+            fprintf(stdout, "---ok---\n");
+        return 0;
+    }
+    cs = cairo_image_surface_create_for_data(shadow
+                                             ? fb_shadow
+                                             : fb_mem + fb_mem_offset,
                                              fb_format,
                                              fb_var.xres,
                                              fb_var.yres,
-                                             fb_fix.line_length);
+                                             shadow
+                                             ? fb_shadow_stride
+                                             : fb_fix.line_length);
     fb_draw(autotest);
+    if (shadow)
+        fb_shadow_flush(fb_buffer(0));
 
     if (autotest)
         fprintf(stdout, "---ok---\n");
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -37,8 +38,11 @@ struct fb_var_screeninfo         fb_var;
 unsigned char                    *fb_mem;
 int			         fb_mem_offset = 0;
 cairo_format_t                   fb_format = CAIRO_FORMAT_INVALID;
+int                              fb_buffers = 1;
+const char                       *fb_convert_name;
 
 static int                       fb;
+static size_t                    fb_mem_len;
 static int                       kd_mode;
 static bool                      kd_mode_restore = false;
 
@@ -83,6 +87,19 @@ static void fb_linear_palette(int r, int g, int b)
 	p_cmap.len = size;
 }
 
+static void fb_cube_palette(void)
+{
+    int i;
+
+    /* 3:3:2 color cube, matches fb_conv_init() for pseudocolor */
+    for (i = 0; i < 256; i++) {
+        p_red[i]   = color_scale((i >> 5) & 0x07, 7);
+        p_green[i] = color_scale((i >> 2) & 0x07, 7);
+        p_blue[i]  = color_scale((i >> 0) & 0x03, 3);
+    }
+    p_cmap.len = 256;
+}
+
 static void fb_set_palette(void)
 {
     if (fb_fix.visual != FB_VISUAL_DIRECTCOLOR && fb_var.bits_per_pixel != 8)
@@ -94,26 +111,370 @@ static void fb_set_palette(void)
 }
 
 /* -------------------------------------------------------------------- */
-/* initialisation & cleanup                                             */
+/* fill                                                                 */
+
+/*
+ * Framebuffer memory is usually mapped uncached or write-combined, so
+ * reads are very slow and the write width matters a lot.  The x86
+ * variants use non-temporal stores, which go straight to the
+ * write-combining buffers without allocating cache lines.  Copies
+ * are meant for system memory -> framebuffer.
+ */
+
+static void fb_fill_scalar(void *addr, uint32_t value, size_t len)
+{
+    uint64_t v = (uint64_t)value << 32 | value;
+    uint32_t *p32 = addr;
+    uint64_t *p64;
+
+    if (((uintptr_t)p32 & 7) && len >= 4) {
+        *(p32++) = value;
+        len -= 4;
+    }
+    for (p64 = (uint64_t*)p32; len >= 8; len -= 8)
+        *(p64++) = v;
+    p32 = (uint32_t*)p64;
+    if (len >= 4) {
+        *(p32++) = value;
+        len -= 4;
+    }
+    /* partial pixel (24bpp lines) */
+    if (len)
+        memcpy(p32, &value, len);
+}
+
+static void fb_copy_scalar(void *dest, const void *src, size_t len)
+{
+    memcpy(dest, src, len);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+static bool fb_fill_sse2_probe(void)
+{
+    return __builtin_cpu_supports("sse2");
+}
+
+__attribute__((target("sse2")))
+static void fb_fill_sse2(void *addr, uint32_t value, size_t len)
+{
+    __m128i v = _mm_set1_epi32(value);
+    uint8_t *p = addr;
+
+    for (; ((uintptr_t)p & 15) && len >= 4; p += 4, len -= 4)
+        *(uint32_t*)p = value;
+    for (; len >= 64; p += 64, len -= 64) {
+        _mm_stream_si128((__m128i*)(p +  0), v);
+        _mm_stream_si128((__m128i*)(p + 16), v);
+        _mm_stream_si128((__m128i*)(p + 32), v);
+        _mm_stream_si128((__m128i*)(p + 48), v);
+    }
+    for (; len >= 16; p += 16, len -= 16)
+        _mm_stream_si128((__m128i*)p, v);
+    _mm_sfence();
+    for (; len >= 4; p += 4, len -= 4)
+        *(uint32_t*)p = value;
+    if (len)
+        memcpy(p, &value, len);
+}
+
+__attribute__((target("sse2")))
+static void fb_copy_sse2(void *dest, const void *src, size_t len)
+{
+    const uint8_t *s = src;
+    uint8_t *d = dest;
+
+    for (; ((uintptr_t)d & 15) && len >= 4; d += 4, s += 4, len -= 4)
+        *(uint32_t*)d = *(const uint32_t*)s;
+    for (; len >= 64; d += 64, s += 64, len -= 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(s +  0));
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+        __m128i e = _mm_loadu_si128((const __m128i*)(s + 48));
+        _mm_stream_si128((__m128i*)(d +  0), a);
+        _mm_stream_si128((__m128i*)(d + 16), b);
+        _mm_stream_si128((__m128i*)(d + 32), c);
+        _mm_stream_si128((__m128i*)(d + 48), e);
+    }
+    for (; len >= 16; d += 16, s += 16, len -= 16)
+        _mm_stream_si128((__m128i*)d, _mm_loadu_si128((const __m128i*)s));
+    _mm_sfence();
+    if (len)
+        memcpy(d, s, len);
+}
+
+static bool fb_fill_avx_probe(void)
+{
+    return __builtin_cpu_supports("avx");
+}
+
+__attribute__((target("avx")))
+static void fb_fill_avx(void *addr, uint32_t value, size_t len)
+{
+    __m256i v = _mm256_set1_epi32(value);
+    uint8_t *p = addr;
+
+    for (; ((uintptr_t)p & 31) && len >= 4; p += 4, len -= 4)
+        *(uint32_t*)p = value;
+    for (; len >= 128; p += 128, len -= 128) {
+        _mm256_stream_si256((__m256i*)(p +  0), v);
+        _mm256_stream_si256((__m256i*)(p + 32), v);
+        _mm256_stream_si256((__m256i*)(p + 64), v);
+        _mm256_stream_si256((__m256i*)(p + 96), v);
+    }
+    for (; len >= 32; p += 32, len -= 32)
+        _mm256_stream_si256((__m256i*)p, v);
+    _mm_sfence();
+    for (; len >= 4; p += 4, len -= 4)
+        *(uint32_t*)p = value;
+    if (len)
+        memcpy(p, &value, len);
+}
 
-static void
-fb_memset (void *addr, int c, size_t len)
+__attribute__((target("avx")))
+static void fb_copy_avx(void *dest, const void *src, size_t len)
 {
-#if 1 /* defined(__powerpc__) */
-    unsigned int i, *p;
+    const uint8_t *s = src;
+    uint8_t *d = dest;
+
+    for (; ((uintptr_t)d & 31) && len >= 4; d += 4, s += 4, len -= 4)
+        *(uint32_t*)d = *(const uint32_t*)s;
+    for (; len >= 128; d += 128, s += 128, len -= 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(s +  0));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(s + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i*)(s + 64));
+        __m256i e = _mm256_loadu_si256((const __m256i*)(s + 96));
+        _mm256_stream_si256((__m256i*)(d +  0), a);
+        _mm256_stream_si256((__m256i*)(d + 32), b);
+        _mm256_stream_si256((__m256i*)(d + 64), c);
+        _mm256_stream_si256((__m256i*)(d + 96), e);
+    }
+    for (; len >= 32; d += 32, s += 32, len -= 32)
+        _mm256_stream_si256((__m256i*)d, _mm256_loadu_si256((const __m256i*)s));
+    _mm_sfence();
+    if (len)
+        memcpy(d, s, len);
+}
 
-    i = (c & 0xff) << 8;
-    i |= i << 16;
-    len >>= 2;
-    for (p = addr; len--; p++)
-	*p = i;
-#else
-    memset(addr, c, len);
 #endif
+
+/* sorted by preference, best last */
+static const struct fb_filler fb_fillers[] = {
+    {
+        .name  = "scalar",
+        .fill  = fb_fill_scalar,
+        .copy  = fb_copy_scalar,
+#if defined(__x86_64__) || defined(__i386__)
+    },{
+        .name  = "sse2-nt",
+        .fill  = fb_fill_sse2,
+        .copy  = fb_copy_sse2,
+        .probe = fb_fill_sse2_probe,
+    },{
+        .name  = "avx-nt",
+        .fill  = fb_fill_avx,
+        .copy  = fb_copy_avx,
+        .probe = fb_fill_avx_probe,
+#endif
+    }
+};
+
+static const struct fb_filler *fb_filler;
+
+/* returns the nr-th implementation supported by the cpu */
+const struct fb_filler *fb_fill_impl(int nr)
+{
+    int i;
+
+    for (i = 0; i < sizeof(fb_fillers)/sizeof(fb_fillers[0]); i++) {
+        if (fb_fillers[i].probe && !fb_fillers[i].probe())
+            continue;
+        if (nr-- == 0)
+            return fb_fillers + i;
+    }
+    return NULL;
+}
+
+const struct fb_filler *fb_fill_best(void)
+{
+    const struct fb_filler *f;
+    int i;
+
+    for (i = 0; !fb_filler; i++) {
+        f = fb_fill_impl(i);
+        if (!fb_fill_impl(i + 1))
+            fb_filler = f;
+    }
+    return fb_filler;
+}
+
+/* value is repeated every 4 bytes, len can be anything */
+void fb_fill(void *addr, uint32_t value, size_t len)
+{
+    fb_fill_best()->fill(addr, value, len);
+}
+
+void fb_copy(void *dest, const void *src, size_t len)
+{
+    fb_fill_best()->copy(dest, src, len);
 }
 
+/* -------------------------------------------------------------------- */
+/* pixel format conversion                                              */
+
+/*
+ * Formats cairo can't render to directly are handled by rendering
+ * xrgb8888 into the shadow buffer and converting scanlines on flush.
+ * The per-channel lookup tables are built from the fb_var bitfields,
+ * so any channel order and depth up to 32 bpp works.
+ */
+
+static uint32_t fb_conv_lut[3][256];
+static void (*fb_conv_row)(void *dest, const uint32_t *src, int width);
+
+static bool fb_is_layout(int bpp, int ro, int rl, int go, int gl, int bo, int bl)
+{
+    return (fb_fix.visual == FB_VISUAL_TRUECOLOR ||
+            fb_fix.visual == FB_VISUAL_DIRECTCOLOR) &&
+        fb_var.bits_per_pixel == bpp &&
+        fb_var.red.offset   == ro && fb_var.red.length   == rl &&
+        fb_var.green.offset == go && fb_var.green.length == gl &&
+        fb_var.blue.offset  == bo && fb_var.blue.length  == bl;
+}
+
+static void fb_conv_lut_init(uint32_t *lut, int offset, int length)
+{
+    uint32_t v;
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        if (length <= 8) {
+            v = i >> (8 - length);
+        } else {
+            /* replicate high bits into the low bits */
+            v = (i << (length - 8)) | (i >> (16 - length));
+        }
+        lut[i] = v << offset;
+    }
+}
+
+static inline uint32_t fb_conv_pixel(uint32_t p)
+{
+    return fb_conv_lut[0][(p >> 16) & 0xff] |
+        fb_conv_lut[1][(p >>  8) & 0xff] |
+        fb_conv_lut[2][(p >>  0) & 0xff];
+}
+
+static void fb_conv_row_8(void *dest, const uint32_t *src, int width)
+{
+    uint8_t *d = dest;
+    int x;
+
+    for (x = 0; x < width; x++)
+        d[x] = fb_conv_pixel(src[x]);
+}
+
+static void fb_conv_row_16(void *dest, const uint32_t *src, int width)
+{
+    uint16_t *d = dest;
+    int x;
+
+    for (x = 0; x < width; x++)
+        d[x] = fb_conv_pixel(src[x]);
+}
+
+static void fb_conv_row_24(void *dest, const uint32_t *src, int width)
+{
+    uint8_t *d = dest;
+    uint32_t p;
+    int x;
+
+    for (x = 0; x < width; x++, d += 3) {
+        p = fb_conv_pixel(src[x]);
+        d[0] = p >>  0;
+        d[1] = p >>  8;
+        d[2] = p >> 16;
+    }
+}
+
+static void fb_conv_row_24_rgb(void *dest, const uint32_t *src, int width)
+{
+    uint8_t *d = dest;
+    int x;
+
+    /* common case: r16 g8 b0, plain byte copy */
+    for (x = 0; x < width; x++, d += 3) {
+        d[0] = src[x] >>  0;
+        d[1] = src[x] >>  8;
+        d[2] = src[x] >> 16;
+    }
+}
+
+static void fb_conv_row_32(void *dest, const uint32_t *src, int width)
+{
+    uint32_t *d = dest;
+    int x;
+
+    for (x = 0; x < width; x++)
+        d[x] = fb_conv_pixel(src[x]);
+}
+
+static bool fb_conv_init(void)
+{
+    bool pseudo = fb_fix.visual == FB_VISUAL_PSEUDOCOLOR;
+
+    if (pseudo && fb_var.bits_per_pixel == 8) {
+        /* palette index, see fb_cube_palette() */
+        fb_conv_lut_init(fb_conv_lut[0], 5, 3);
+        fb_conv_lut_init(fb_conv_lut[1], 2, 3);
+        fb_conv_lut_init(fb_conv_lut[2], 0, 2);
+        fb_conv_row = fb_conv_row_8;
+        fb_convert_name = "rgb332 palette";
+        return true;
+    }
+    if (fb_fix.visual != FB_VISUAL_TRUECOLOR &&
+        fb_fix.visual != FB_VISUAL_DIRECTCOLOR)
+        return false;
+    if (fb_var.red.length   > 16 || fb_var.red.length   == 0 ||
+        fb_var.green.length > 16 || fb_var.green.length == 0 ||
+        fb_var.blue.length  > 16 || fb_var.blue.length  == 0)
+        return false;
+
+    fb_conv_lut_init(fb_conv_lut[0], fb_var.red.offset,   fb_var.red.length);
+    fb_conv_lut_init(fb_conv_lut[1], fb_var.green.offset, fb_var.green.length);
+    fb_conv_lut_init(fb_conv_lut[2], fb_var.blue.offset,  fb_var.blue.length);
+    switch (fb_var.bits_per_pixel) {
+    case 8:
+        fb_conv_row = fb_conv_row_8;
+        break;
+    case 16:
+        fb_conv_row = fb_conv_row_16;
+        break;
+    case 24:
+        if (fb_is_layout(24, 16,8, 8,8, 0,8))
+            fb_conv_row = fb_conv_row_24_rgb;
+        else
+            fb_conv_row = fb_conv_row_24;
+        break;
+    case 32:
+        fb_conv_row = fb_conv_row_32;
+        break;
+    default:
+        return false;
+    }
+    fb_convert_name = "bitfields";
+    return true;
+}
+
+/* -------------------------------------------------------------------- */
+/* initialisation & cleanup                                             */
+
 void fb_fini(void)
 {
+    fb_shadow_fini();
+
     /* restore console */
     if (-1 == ioctl(fb, FBIOPUT_VSCREENINFO, &fb_ovar))
 	perror("ioctl FBIOPUT_VSCREENINFO");
@@ -203,6 +564,7 @@ void fb_init(int cardno)
     }
     page_mask = getpagesize()-1;
     fb_mem_offset = (unsigned long)(fb_fix.smem_start) & page_mask;
+    fb_mem_len = fb_fix.smem_len;
     fb_mem = mmap(NULL,fb_fix.smem_len+fb_mem_offset,
 		  PROT_READ|PROT_WRITE,MAP_SHARED,fb,0);
     if (-1L == (long)fb_mem) {
@@ -220,23 +582,35 @@ void fb_init(int cardno)
     }
 
     /* cls */
-    fb_memset(fb_mem+fb_mem_offset, 0, fb_fix.line_length * fb_var.yres);
+    fb_fill(fb_mem+fb_mem_offset, 0, fb_fix.line_length * fb_var.yres);
 
     /* init palette */
-    switch (fb_var.bits_per_pixel) {
-    case 16:
+    if (fb_is_layout(16, 11,5, 5,6, 0,5)) {
         fb_format = CAIRO_FORMAT_RGB16_565;
         fb_linear_palette(5,6,5);
-	break;
-    case 32:
+    } else if (fb_is_layout(32, 16,8, 8,8, 0,8)) {
         fb_format = CAIRO_FORMAT_RGB24;
         fb_linear_palette(8,8,8);
-	break;
-    default:
+#if CAIRO_VERSION >= CAIRO_VERSION_ENCODE(1, 12, 0)
+    } else if (fb_is_layout(32, 20,10, 10,10, 0,10) &&
+               fb_fix.visual == FB_VISUAL_TRUECOLOR) {
+        fb_format = CAIRO_FORMAT_RGB30;
+#endif
+    } else if (fb_conv_init()) {
+        /* render xrgb8888 into the shadow buffer, convert on flush */
+        fb_format = CAIRO_FORMAT_RGB24;
+        if (fb_fix.visual == FB_VISUAL_PSEUDOCOLOR)
+            fb_cube_palette();
+        else if (fb_var.red.length   <= 8 &&
+                 fb_var.green.length <= 8 &&
+                 fb_var.blue.length  <= 8)
+            fb_linear_palette(fb_var.red.length,
+                              fb_var.green.length,
+                              fb_var.blue.length);
+    } else {
         fprintf(stderr, "unsupported framebuffer format (%d bpp)\n",
                 fb_var.bits_per_pixel);
         goto err;
-
     }
     fb_set_palette();
     return;
@@ -245,3 +619,135 @@ void fb_init(int cardno)
     fb_fini();
     exit(1);
 }
+
+/* -------------------------------------------------------------------- */
+/* page flipping                                                        */
+
+bool fb_flip_init(void)
+{
+    struct fb_var_screeninfo var = fb_var;
+
+    if (fb_var.yres_virtual < fb_var.yres * 2) {
+        /* ask for a virtual screen large enough for two buffers */
+        var.yres_virtual = fb_var.yres * 2;
+        if (-1 == ioctl(fb,FBIOPUT_VSCREENINFO,&var))
+            return false;
+        if (-1 == ioctl(fb,FBIOGET_VSCREENINFO,&var))
+            return false;
+        if (-1 == ioctl(fb,FBIOGET_FSCREENINFO,&fb_fix))
+            return false;
+        fb_var = var;
+    }
+    if (fb_var.yres_virtual < fb_var.yres * 2)
+        return false;
+    if (!fb_fix.ypanstep)
+        return false;
+    if ((size_t)fb_fix.line_length * fb_var.yres * 2 > fb_mem_len)
+        return false;
+
+    fb_buffers = 2;
+    fb_fill(fb_buffer(1), 0, fb_fix.line_length * fb_var.yres);
+    return true;
+}
+
+unsigned char *fb_buffer(int nr)
+{
+    return fb_mem + fb_mem_offset +
+        (size_t)nr * fb_var.yres * fb_fix.line_length;
+}
+
+int fb_flip(int nr, bool vsync)
+{
+    uint32_t crtc = 0;
+
+    if (vsync && -1 == ioctl(fb,FBIO_WAITFORVSYNC,&crtc))
+        return -1;
+    fb_var.xoffset = 0;
+    fb_var.yoffset = nr * fb_var.yres;
+    if (-1 == ioctl(fb,FBIOPAN_DISPLAY,&fb_var))
+        return -1;
+    return 0;
+}
+
+/* -------------------------------------------------------------------- */
+/* shadow buffer                                                        */
+
+/*
+ * Render into cached system memory, then copy changed scanlines to
+ * the framebuffer.  fb_front has the framebuffer contents, so finding
+ * changed rows doesn't need framebuffer reads.
+ */
+
+unsigned char                    *fb_shadow;
+int                              fb_shadow_stride;
+static unsigned char             *fb_front;
+static unsigned char             *fb_row;
+
+void fb_shadow_init(void)
+{
+    size_t len;
+
+    /* with conversion the shadow has xrgb8888 pixels */
+    fb_shadow_stride = fb_conv_row ? fb_var.xres * 4 : fb_fix.line_length;
+    len = (size_t)fb_shadow_stride * fb_var.yres;
+    if (posix_memalign((void**)&fb_shadow, 64, len) ||
+        posix_memalign((void**)&fb_front, 64, len) ||
+        posix_memalign((void**)&fb_row, 64, fb_fix.line_length)) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    /* fb_init() has cleared the screen */
+    memset(fb_shadow, 0, len);
+    memset(fb_front, 0, len);
+}
+
+void fb_shadow_fini(void)
+{
+    free(fb_shadow);
+    free(fb_front);
+    free(fb_row);
+    fb_shadow = NULL;
+    fb_front = NULL;
+    fb_row = NULL;
+}
+
+static void fb_shadow_copy(unsigned char *dest, int start, int end)
+{
+    size_t ll = fb_fix.line_length;
+    size_t ss = fb_shadow_stride;
+    int y;
+
+    if (!fb_conv_row) {
+        fb_copy(dest + start * ll, fb_shadow + start * ss, (end - start) * ll);
+        return;
+    }
+    /* convert in cached memory, then write out the row with wide stores */
+    for (y = start; y < end; y++) {
+        fb_conv_row(fb_row, (uint32_t*)(fb_shadow + y * ss), fb_var.xres);
+        fb_copy(dest + y * ll, fb_row, ll);
+    }
+}
+
+/* returns the number of scanlines copied */
+int fb_shadow_flush(unsigned char *dest)
+{
+    size_t ss = fb_shadow_stride;
+    int y, start = -1, rows = 0;
+
+    for (y = 0; y <= fb_var.yres; y++) {
+        if (y < fb_var.yres &&
+            memcmp(fb_shadow + y * ss, fb_front + y * ss, ss) != 0) {
+            memcpy(fb_front + y * ss, fb_shadow + y * ss, ss);
+            if (start < 0)
+                start = y;
+            continue;
+        }
+        if (start < 0)
+            continue;
+        /* copy a block of dirty rows */
+        fb_shadow_copy(dest, start, y);
+        rows += y - start;
+        start = -1;
+    }
+    return rows;
+}
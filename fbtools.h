@@ -5,7 +5,31 @@ extern struct fb_var_screeninfo fb_var;
 extern unsigned char            *fb_mem;
 extern int		        fb_mem_offset;
 extern cairo_format_t           fb_format;
+extern int                      fb_buffers;
+extern const char               *fb_convert_name;
+extern unsigned char            *fb_shadow;
+extern int                      fb_shadow_stride;
+
+struct fb_filler {
+    const char *name;
+    void (*fill)(void *addr, uint32_t value, size_t len);
+    void (*copy)(void *dest, const void *src, size_t len);
+    bool (*probe)(void);
+};
+
+const struct fb_filler *fb_fill_impl(int nr);
+const struct fb_filler *fb_fill_best(void);
+void fb_fill(void *addr, uint32_t value, size_t len);
+void fb_copy(void *dest, const void *src, size_t len);
 
 void fb_query(int devnr);
 void fb_init(int devnr);
 void fb_fini(void);
+
+bool fb_flip_init(void);
+unsigned char *fb_buffer(int nr);
+int fb_flip(int nr, bool vsync);
+
+void fb_shadow_init(void);
+void fb_shadow_fini(void);
+int fb_shadow_flush(unsigned char *dest);
@@ -119,7 +119,7 @@ int main(int argc, char *argv[])
 
     if (ifile) {
         fprintf(stderr, "loading %s ...\n", ifile);
-        image = load_image(ifile);
+        image = load_image(ifile, 0, 0);
     }
 
     gtk_widget_show_all(window);
@@ -1,19 +1,101 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <inttypes.h>
 #include <string.h>
 #include <strings.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <endian.h>
 
+#include <sys/stat.h>
+#include <sys/mman.h>
+
 #include <jpeglib.h>
 #include <jerror.h>
 #include <cairo.h>
 
 #include "image.h"
 
-static cairo_surface_t *load_jpeg(const char* filename)
+/* largest size with the image aspect ratio fitting into width x height */
+static void image_fit(int iw, int ih, int width, int height,
+                      int *ow, int *oh)
+{
+    if ((double)width / iw > (double)height / ih) {
+        *oh = height;
+        *ow = (iw * height + ih / 2) / ih;
+    } else {
+        *ow = width;
+        *oh = (ih * width + iw / 2) / iw;
+    }
+    if (*ow < 1)
+        *ow = 1;
+    if (*oh < 1)
+        *oh = 1;
+}
+
+/* one high quality resample to the final size, frees the source */
+static cairo_surface_t *image_scale(cairo_surface_t *src, int width, int height)
+{
+    cairo_surface_t *dst;
+    cairo_t *cr;
+    int iw, ih, ow, oh;
+
+    if (cairo_surface_status(src) != CAIRO_STATUS_SUCCESS)
+        return src;
+    iw = cairo_image_surface_get_width(src);
+    ih = cairo_image_surface_get_height(src);
+    if (!width || !height)
+        return src;
+    image_fit(iw, ih, width, height, &ow, &oh);
+    if (ow == iw && oh == ih)
+        return src;
+
+    dst = cairo_image_surface_create(CAIRO_FORMAT_RGB24, ow, oh);
+    if (cairo_surface_status(dst) != CAIRO_STATUS_SUCCESS) {
+        fprintf(stderr, "cairo_image_surface_create failed\n");
+        exit(1);
+    }
+    cr = cairo_create(dst);
+    cairo_scale(cr, (double)ow / iw, (double)oh / ih);
+    cairo_set_source_surface(cr, src, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_BEST);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_destroy(src);
+    return dst;
+}
+
+/*
+ * Let libjpeg scale down in the dct domain (1/2, 1/4, 1/8) as long as
+ * the result is still at least as large as the final size.  That is
+ * much faster and needs a fraction of the memory compared to decoding
+ * at full size.
+ */
+static void jpeg_pick_scale(struct jpeg_decompress_struct *info,
+                            int width, int height)
+{
+    int ow, oh, denom;
+
+    info->scale_num = 1;
+    info->scale_denom = 1;
+    if (!width || !height)
+        return;
+    image_fit(info->image_width, info->image_height, width, height, &ow, &oh);
+    for (denom = 8; denom > 1; denom /= 2) {
+        if (info->image_width / denom >= ow &&
+            info->image_height / denom >= oh)
+            break;
+    }
+    info->scale_denom = denom;
+}
+
+static cairo_surface_t *load_jpeg(const char* filename, int width, int height)
 {
     struct jpeg_decompress_struct info;
     struct jpeg_error_mgr err;
@@ -32,6 +114,7 @@ static cairo_surface_t *load_jpeg(const char* filename)
 
     jpeg_stdio_src(&info, file);
     jpeg_read_header(&info, TRUE);
+    jpeg_pick_scale(&info, width, height);
 #if __BYTE_ORDER == __LITTLE_ENDIAN
     info.out_color_space = JCS_EXT_BGRX;
 #else
@@ -53,12 +136,14 @@ static cairo_surface_t *load_jpeg(const char* filename)
         jpeg_read_scanlines(&info, rowptr, 1);
     }
     jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
 
     fclose(file);
-    return surface;
+    return image_scale(surface, width, height);
 }
 
-cairo_surface_t *load_image(const char* filename)
+static cairo_surface_t *decode_image(const char* filename,
+                                     int width, int height)
 {
     const char *ext = strrchr(filename, '.');
 
@@ -69,11 +154,219 @@ cairo_surface_t *load_image(const char* filename)
 
     if (strcasecmp(ext, ".jpeg") == 0 ||
         strcasecmp(ext, ".jpg") == 0)
-        return load_jpeg(filename);
+        return load_jpeg(filename, width, height);
 
     if (strcasecmp(ext, ".png") == 0)
-        return cairo_image_surface_create_from_png(filename);
+        return image_scale(cairo_image_surface_create_from_png(filename),
+                           width, height);
 
     fprintf(stderr, "unknown file extension: \"%s\"\n", ext);
     exit(1);
 }
+
+/* ------------------------------------------------------------------ */
+/* decoded image cache                                                */
+
+/*
+ * Decoded and scaled images are stored as raw pixels in
+ * $XDG_CACHE_HOME/drminfo (~/.cache/drminfo), one file per source
+ * path and target size.  The pixel data is page aligned, so a cache
+ * hit is a single mmap and the pages are shared via page cache by all
+ * processes showing the same image.  Any cache problem just means the
+ * image gets decoded again.
+ */
+
+#define IMAGE_CACHE_MAGIC "drmimg1"
+
+struct image_cache_hdr {
+    char     magic[8];
+    /* key: source file (path follows the header) and target */
+    uint64_t mtime_sec, mtime_nsec, size;
+    int32_t  target_width, target_height;
+    uint32_t pathlen;
+    /* pixel data */
+    int32_t  format;      /* cairo_format_t */
+    int32_t  width, height, stride;
+    uint32_t offset;      /* page aligned */
+};
+
+static const cairo_user_data_key_t image_cache_key;
+
+struct image_cache_map {
+    void   *ptr;
+    size_t len;
+};
+
+static void image_cache_unmap(void *data)
+{
+    struct image_cache_map *map = data;
+
+    munmap(map->ptr, map->len);
+    free(map);
+}
+
+static bool image_cache_file(const char *path, int width, int height,
+                             char *dest, size_t len)
+{
+    const char *dir = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    uint64_t hash = 14695981039346656037ull;
+    char key[32];
+    const char *c;
+    size_t pos;
+
+    if (dir)
+        pos = snprintf(dest, len, "%s", dir);
+    else if (home)
+        pos = snprintf(dest, len, "%s/.cache", home);
+    else
+        return false;
+    if (pos >= len)
+        return false;
+    mkdir(dest, 0700);
+    pos += snprintf(dest + pos, len - pos, "/drminfo");
+    if (pos >= len)
+        return false;
+    if (mkdir(dest, 0700) < 0 && errno != EEXIST)
+        return false;
+
+    /* fnv-1a over path and target size */
+    snprintf(key, sizeof(key), ":%dx%d", width, height);
+    for (c = path; *c; c++)
+        hash = (hash ^ (uint8_t)*c) * 1099511628211ull;
+    for (c = key; *c; c++)
+        hash = (hash ^ (uint8_t)*c) * 1099511628211ull;
+    pos += snprintf(dest + pos, len - pos, "/%016" PRIx64 ".img", hash);
+    return pos < len;
+}
+
+static void image_cache_key_init(struct image_cache_hdr *hdr,
+                                 const char *path, struct stat *st,
+                                 int width, int height)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, IMAGE_CACHE_MAGIC, sizeof(hdr->magic));
+    hdr->mtime_sec     = st->st_mtim.tv_sec;
+    hdr->mtime_nsec    = st->st_mtim.tv_nsec;
+    hdr->size          = st->st_size;
+    hdr->target_width  = width;
+    hdr->target_height = height;
+    hdr->pathlen       = strlen(path);
+}
+
+static cairo_surface_t *image_cache_load(const char *cfile, const char *path,
+                                         struct image_cache_hdr *key)
+{
+    struct image_cache_hdr hdr;
+    struct image_cache_map *map;
+    cairo_surface_t *surface;
+    struct stat st;
+    char *cpath;
+    void *ptr;
+    int fd;
+
+    fd = open(cfile, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        memcmp(&hdr, key, offsetof(struct image_cache_hdr, format)) != 0 ||
+        fstat(fd, &st) < 0 ||
+        hdr.offset < sizeof(hdr) + hdr.pathlen ||
+        hdr.height <= 0 ||
+        hdr.stride != cairo_format_stride_for_width(hdr.format, hdr.width) ||
+        st.st_size < hdr.offset + (off_t)hdr.stride * hdr.height) {
+        close(fd);
+        return NULL;
+    }
+
+    /* private + writable: cairo wants writable data, pages stay shared */
+    ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return NULL;
+    cpath = (char *)ptr + sizeof(hdr);
+    if (memcmp(cpath, path, hdr.pathlen) != 0) {
+        munmap(ptr, st.st_size);
+        return NULL;
+    }
+
+    surface = cairo_image_surface_create_for_data((uint8_t *)ptr + hdr.offset,
+                                                  hdr.format,
+                                                  hdr.width, hdr.height,
+                                                  hdr.stride);
+    map = malloc(sizeof(*map));
+    map->ptr = ptr;
+    map->len = st.st_size;
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS ||
+        cairo_surface_set_user_data(surface, &image_cache_key, map,
+                                    image_cache_unmap) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        image_cache_unmap(map);
+        return NULL;
+    }
+    return surface;
+}
+
+static void image_cache_store(const char *cfile, const char *path,
+                              struct image_cache_hdr *hdr,
+                              cairo_surface_t *surface)
+{
+    long pagesize = sysconf(_SC_PAGESIZE);
+    char tmp[PATH_MAX + 16];
+    uint8_t *data;
+    ssize_t len;
+    bool ok;
+    int fd;
+
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS ||
+        cairo_surface_get_type(surface) != CAIRO_SURFACE_TYPE_IMAGE)
+        return;
+    cairo_surface_flush(surface);
+    data = cairo_image_surface_get_data(surface);
+    hdr->format = cairo_image_surface_get_format(surface);
+    hdr->width  = cairo_image_surface_get_width(surface);
+    hdr->height = cairo_image_surface_get_height(surface);
+    hdr->stride = cairo_image_surface_get_stride(surface);
+    hdr->offset = (sizeof(*hdr) + hdr->pathlen + pagesize - 1) & ~(pagesize - 1);
+    len = (ssize_t)hdr->stride * hdr->height;
+
+    /* write to a temporary file, then rename, so readers never see
+     * a partial file */
+    snprintf(tmp, sizeof(tmp), "%s.%d", cfile, getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return;
+    /* fsync: after a power loss a renamed file might otherwise have a
+     * valid header but no pixels, and would be served forever */
+    ok = (pwrite(fd, hdr, sizeof(*hdr), 0) == sizeof(*hdr) &&
+          pwrite(fd, path, hdr->pathlen, sizeof(*hdr)) == hdr->pathlen &&
+          pwrite(fd, data, len, hdr->offset) == len &&
+          fsync(fd) == 0);
+    if (close(fd) < 0 || !ok || rename(tmp, cfile) < 0)
+        unlink(tmp);
+}
+
+cairo_surface_t *load_image(const char* filename, int width, int height)
+{
+    struct image_cache_hdr key;
+    cairo_surface_t *surface;
+    char cfile[PATH_MAX];
+    struct stat st;
+    char *path;
+
+    path = realpath(filename, NULL);
+    if (!path || stat(path, &st) < 0 ||
+        !image_cache_file(path, width, height, cfile, sizeof(cfile))) {
+        free(path);
+        return decode_image(filename, width, height);
+    }
+
+    image_cache_key_init(&key, path, &st, width, height);
+    surface = image_cache_load(cfile, path, &key);
+    if (!surface) {
+        surface = decode_image(filename, width, height);
+        image_cache_store(cfile, path, &key, surface);
+    }
+    free(path);
+    return surface;
+}
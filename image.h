@@ -1,2 +1,2 @@
-cairo_surface_t *load_image(const char* filename);
-
+/* width/height: fit the image into that size, 0 to keep the original */
+cairo_surface_t *load_image(const char* filename, int width, int height);
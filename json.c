@@ -0,0 +1,590 @@
+/*
+ * minimal json support: streaming writer, parser, tree diff.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "json.h"
+
+#define JSON_MAX_DEPTH 32
+
+/* ------------------------------------------------------------------ */
+/* writer                                                             */
+
+static FILE *jfp;
+static int jdepth;
+static bool jfirst[JSON_MAX_DEPTH];
+
+static void json_print_string(FILE *fp, const char *str)
+{
+    const unsigned char *s = (const unsigned char *)str;
+
+    fputc('"', fp);
+    for (; *s; s++) {
+        switch (*s) {
+        case '"':  fputs("\\\"", fp); break;
+        case '\\': fputs("\\\\", fp); break;
+        case '\n': fputs("\\n", fp);  break;
+        case '\t': fputs("\\t", fp);  break;
+        default:
+            if (*s < 0x20)
+                fprintf(fp, "\\u%04x", *s);
+            else
+                fputc(*s, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static void json_key(const char *key)
+{
+    if (!jfirst[jdepth])
+        fputc(',', jfp);
+    jfirst[jdepth] = false;
+    if (jdepth)
+        fprintf(jfp, "\n%*s", jdepth * 2, "");
+    if (key) {
+        json_print_string(jfp, key);
+        fputs(": ", jfp);
+    }
+}
+
+static void json_open(const char *key, char c)
+{
+    json_key(key);
+    fputc(c, jfp);
+    if (jdepth + 1 >= JSON_MAX_DEPTH) {
+        fprintf(stderr, "json: nesting too deep\n");
+        exit(1);
+    }
+    jfirst[++jdepth] = true;
+}
+
+static void json_close(char c)
+{
+    bool empty = jfirst[jdepth];
+
+    jdepth--;
+    if (!empty)
+        fprintf(jfp, "\n%*s", jdepth * 2, "");
+    fputc(c, jfp);
+}
+
+void json_start(FILE *fp)
+{
+    jfp = fp;
+    jdepth = 0;
+    jfirst[0] = true;
+}
+
+void json_finish(void)
+{
+    fputc('\n', jfp);
+}
+
+void json_object_start(const char *key)
+{
+    json_open(key, '{');
+}
+
+void json_object_end(void)
+{
+    json_close('}');
+}
+
+void json_array_start(const char *key)
+{
+    json_open(key, '[');
+}
+
+void json_array_end(void)
+{
+    json_close(']');
+}
+
+void json_string(const char *key, const char *value)
+{
+    json_key(key);
+    json_print_string(jfp, value);
+}
+
+void json_int(const char *key, int64_t value)
+{
+    json_key(key);
+    fprintf(jfp, "%" PRId64, value);
+}
+
+void json_uint(const char *key, uint64_t value)
+{
+    json_key(key);
+    fprintf(jfp, "%" PRIu64, value);
+}
+
+void json_bool(const char *key, bool value)
+{
+    json_key(key);
+    fputs(value ? "true" : "false", jfp);
+}
+
+void json_hex(const char *key, const void *data, size_t len)
+{
+    const uint8_t *d = data;
+    size_t i;
+
+    json_key(key);
+    fputc('"', jfp);
+    for (i = 0; i < len; i++)
+        fprintf(jfp, "%02x", d[i]);
+    fputc('"', jfp);
+}
+
+/* ------------------------------------------------------------------ */
+/* parser                                                             */
+
+struct json_parser {
+    const char *filename;
+    const char *pos;
+    int line;
+};
+
+static void json_parse_error(struct json_parser *p, const char *msg)
+{
+    fprintf(stderr, "%s:%d: json parse error: %s\n",
+            p->filename, p->line, msg);
+    exit(1);
+}
+
+static void json_skip_space(struct json_parser *p)
+{
+    for (;;) {
+        switch (*p->pos) {
+        case '\n':
+            p->line++;
+            /* fall through */
+        case ' ':
+        case '\t':
+        case '\r':
+            p->pos++;
+            break;
+        default:
+            return;
+        }
+    }
+}
+
+/* four hex digits after "\u", p->pos points to the 'u' */
+static unsigned int json_parse_hex4(struct json_parser *p)
+{
+    unsigned int u = 0;
+    int i;
+    char c;
+
+    for (i = 1; i <= 4; i++) {
+        c = p->pos[i];
+        u <<= 4;
+        if (c >= '0' && c <= '9')
+            u |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            u |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            u |= c - 'A' + 10;
+        else
+            json_parse_error(p, "bad \\u escape");
+    }
+    p->pos += 4;
+    return u;
+}
+
+static char *json_parse_string(struct json_parser *p)
+{
+    char *str, *d;
+    unsigned int u, lo;
+
+    if (*p->pos != '"')
+        json_parse_error(p, "string expected");
+    p->pos++;
+
+    /* unescaped string is never longer than the escaped one */
+    str = malloc(strlen(p->pos) + 1);
+    d = str;
+    while (*p->pos != '"') {
+        if (*p->pos == 0 || *p->pos == '\n')
+            json_parse_error(p, "unterminated string");
+        if (*p->pos != '\\') {
+            *d++ = *p->pos++;
+            continue;
+        }
+        p->pos++;
+        switch (*p->pos) {
+        case 'b': *d++ = '\b'; break;
+        case 'f': *d++ = '\f'; break;
+        case 'n': *d++ = '\n'; break;
+        case 'r': *d++ = '\r'; break;
+        case 't': *d++ = '\t'; break;
+        case 'u':
+            u = json_parse_hex4(p);
+            if (u >= 0xdc00 && u <= 0xdfff)
+                json_parse_error(p, "unpaired low surrogate");
+            if (u >= 0xd800 && u <= 0xdbff) {
+                /* surrogate pair, must be followed by the low half */
+                if (p->pos[1] != '\\' || p->pos[2] != 'u')
+                    json_parse_error(p, "unpaired high surrogate");
+                p->pos += 2;
+                lo = json_parse_hex4(p);
+                if (lo < 0xdc00 || lo > 0xdfff)
+                    json_parse_error(p, "unpaired high surrogate");
+                u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+            }
+            if (u < 0x80) {
+                *d++ = u;
+            } else if (u < 0x800) {
+                *d++ = 0xc0 | (u >> 6);
+                *d++ = 0x80 | (u & 0x3f);
+            } else if (u < 0x10000) {
+                *d++ = 0xe0 | (u >> 12);
+                *d++ = 0x80 | ((u >> 6) & 0x3f);
+                *d++ = 0x80 | (u & 0x3f);
+            } else {
+                *d++ = 0xf0 | (u >> 18);
+                *d++ = 0x80 | ((u >> 12) & 0x3f);
+                *d++ = 0x80 | ((u >> 6) & 0x3f);
+                *d++ = 0x80 | (u & 0x3f);
+            }
+            break;
+        default:
+            *d++ = *p->pos;
+            break;
+        }
+        p->pos++;
+    }
+    p->pos++;
+    *d = 0;
+    return str;
+}
+
+static struct json_node *json_parse_value(struct json_parser *p, int depth)
+{
+    struct json_node *node, **tail;
+    const char *start;
+    char close;
+
+    if (depth >= JSON_MAX_DEPTH)
+        json_parse_error(p, "nesting too deep");
+
+    node = calloc(1, sizeof(*node));
+    json_skip_space(p);
+    switch (*p->pos) {
+    case '{':
+    case '[':
+        node->type = (*p->pos == '{') ? JSON_OBJECT : JSON_ARRAY;
+        close = (*p->pos == '{') ? '}' : ']';
+        p->pos++;
+        tail = &node->child;
+        json_skip_space(p);
+        if (*p->pos == close) {
+            p->pos++;
+            break;
+        }
+        for (;;) {
+            char *key = NULL;
+            if (node->type == JSON_OBJECT) {
+                json_skip_space(p);
+                key = json_parse_string(p);
+                json_skip_space(p);
+                if (*p->pos != ':')
+                    json_parse_error(p, "':' expected");
+                p->pos++;
+            }
+            *tail = json_parse_value(p, depth + 1);
+            (*tail)->key = key;
+            tail = &(*tail)->next;
+            json_skip_space(p);
+            if (*p->pos == ',') {
+                p->pos++;
+                continue;
+            }
+            if (*p->pos != close)
+                json_parse_error(p, "',' or end of list expected");
+            p->pos++;
+            break;
+        }
+        break;
+    case '"':
+        node->type = JSON_STRING;
+        node->value = json_parse_string(p);
+        break;
+    default:
+        start = p->pos;
+        while (*p->pos && strchr("+-.0123456789eEtrufalsn", *p->pos))
+            p->pos++;
+        if (p->pos == start)
+            json_parse_error(p, "unexpected character");
+        node->value = strndup(start, p->pos - start);
+        if (strcmp(node->value, "true") == 0 ||
+            strcmp(node->value, "false") == 0) {
+            node->type = JSON_BOOL;
+        } else if (strcmp(node->value, "null") == 0) {
+            node->type = JSON_NULL;
+        } else {
+            node->type = JSON_NUMBER;
+        }
+        break;
+    }
+    return node;
+}
+
+struct json_node *json_parse_file(const char *filename)
+{
+    struct json_parser p = {
+        .filename = filename,
+        .line     = 1,
+    };
+    struct json_node *node;
+    char *buf = NULL;
+    size_t len = 0, rc;
+    FILE *fp;
+
+    fp = fopen(filename, "r");
+    if (!fp) {
+        fprintf(stderr, "open %s: %s\n", filename, strerror(errno));
+        exit(1);
+    }
+    do {
+        buf = realloc(buf, len + 65536 + 1);
+        rc = fread(buf + len, 1, 65536, fp);
+        len += rc;
+    } while (rc > 0);
+    buf[len] = 0;
+    fclose(fp);
+
+    p.pos = buf;
+    node = json_parse_value(&p, 0);
+    json_skip_space(&p);
+    if (*p.pos)
+        json_parse_error(&p, "trailing garbage");
+    free(buf);
+    return node;
+}
+
+void json_free(struct json_node *node)
+{
+    struct json_node *next;
+
+    while (node) {
+        next = node->next;
+        json_free(node->child);
+        free(node->key);
+        free(node->value);
+        free(node);
+        node = next;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* diff                                                               */
+
+static void json_print_compact(FILE *fp, struct json_node *node)
+{
+    struct json_node *c;
+
+    switch (node->type) {
+    case JSON_OBJECT:
+    case JSON_ARRAY:
+        fputc(node->type == JSON_OBJECT ? '{' : '[', fp);
+        for (c = node->child; c; c = c->next) {
+            if (c->key) {
+                json_print_string(fp, c->key);
+                fputc(':', fp);
+            }
+            json_print_compact(fp, c);
+            if (c->next)
+                fputc(',', fp);
+        }
+        fputc(node->type == JSON_OBJECT ? '}' : ']', fp);
+        break;
+    case JSON_STRING:
+        json_print_string(fp, node->value);
+        break;
+    default:
+        fputs(node->value, fp);
+        break;
+    }
+}
+
+static bool json_equal(struct json_node *a, struct json_node *b)
+{
+    struct json_node *ca, *cb;
+
+    if (a->type != b->type)
+        return false;
+    if (a->value || b->value)
+        return a->value && b->value && strcmp(a->value, b->value) == 0;
+    for (ca = a->child, cb = b->child; ca && cb; ca = ca->next, cb = cb->next) {
+        if ((ca->key || cb->key) &&
+            (!ca->key || !cb->key || strcmp(ca->key, cb->key) != 0))
+            return false;
+        if (!json_equal(ca, cb))
+            return false;
+    }
+    return ca == NULL && cb == NULL;
+}
+
+static struct json_node *json_find_key(struct json_node *obj, const char *key)
+{
+    struct json_node *c;
+
+    for (c = obj->child; c; c = c->next)
+        if (strcmp(c->key, key) == 0)
+            return c;
+    return NULL;
+}
+
+static int json_report(FILE *fp, const char *what, const char *path,
+                       struct json_node *a, struct json_node *b)
+{
+    fprintf(fp, "%-8s %s:", what, path[0] ? path : "/");
+    if (a) {
+        fputc(' ', fp);
+        json_print_compact(fp, a);
+    }
+    if (a && b)
+        fputs(" ->", fp);
+    if (b) {
+        fputc(' ', fp);
+        json_print_compact(fp, b);
+    }
+    fputc('\n', fp);
+    return 1;
+}
+
+/*
+ * Key for matching array elements: scalars by value, modes by name and
+ * clock, edid mode entries by source and mode.  Returns false for
+ * elements without a key, those are matched by content only.
+ */
+static bool json_elem_key(struct json_node *n, char *buf, size_t len)
+{
+    struct json_node *name, *clock, *source, *mode;
+    char sub[128];
+
+    if (n->type != JSON_OBJECT && n->type != JSON_ARRAY) {
+        snprintf(buf, len, "%s", n->value);
+        return true;
+    }
+    if (n->type != JSON_OBJECT)
+        return false;
+
+    mode = json_find_key(n, "mode");
+    source = json_find_key(n, "source");
+    if (mode && json_elem_key(mode, sub, sizeof(sub))) {
+        snprintf(buf, len, "%s%s%s",
+                 source && source->value ? source->value : "",
+                 source && source->value ? " " : "", sub);
+        return true;
+    }
+
+    name = json_find_key(n, "name");
+    clock = json_find_key(n, "clock");
+    if (!name || !name->value)
+        return false;
+    if (clock && clock->value)
+        snprintf(buf, len, "%s@%s", name->value, clock->value);
+    else
+        snprintf(buf, len, "%s", name->value);
+    return true;
+}
+
+static int json_diff_path(FILE *fp, char *path, size_t plen,
+                          struct json_node *a, struct json_node *b)
+{
+    struct json_node *ca, *cb, *best;
+    size_t len = strlen(path);
+    char ka[256], kb[256];
+    int i, bi = 0, diffs = 0;
+    bool *matched;
+
+    if (a->type != b->type ||
+        (a->type != JSON_OBJECT && a->type != JSON_ARRAY)) {
+        if (json_equal(a, b))
+            return 0;
+        return json_report(fp, "changed", path, a, b);
+    }
+
+    if (a->type == JSON_OBJECT) {
+        /* compare members by key */
+        for (ca = a->child; ca; ca = ca->next) {
+            snprintf(path + len, plen - len, "/%s", ca->key);
+            cb = json_find_key(b, ca->key);
+            if (cb)
+                diffs += json_diff_path(fp, path, plen, ca, cb);
+            else
+                diffs += json_report(fp, "removed", path, ca, NULL);
+        }
+        for (cb = b->child; cb; cb = cb->next) {
+            if (json_find_key(a, cb->key))
+                continue;
+            snprintf(path + len, plen - len, "/%s", cb->key);
+            diffs += json_report(fp, "added", path, NULL, cb);
+        }
+        path[len] = 0;
+        return diffs;
+    }
+
+    /*
+     * arrays: element order doesn't matter.  Pair up elements by a
+     * stable key (see json_elem_key) and diff the pairs, so a changed
+     * mode shows up as a changed field instead of removed + added.
+     */
+    for (i = 0, cb = b->child; cb; cb = cb->next)
+        i++;
+    matched = calloc(i + 1, sizeof(bool));
+    for (ca = a->child; ca; ca = ca->next) {
+        if (!json_elem_key(ca, ka, sizeof(ka)))
+            ka[0] = 0;
+        /* prefer an identical element in case keys are not unique */
+        best = NULL;
+        for (i = 0, cb = b->child; cb; cb = cb->next, i++) {
+            if (matched[i])
+                continue;
+            if (ka[0] && (!json_elem_key(cb, kb, sizeof(kb)) ||
+                          strcmp(ka, kb) != 0))
+                continue;
+            if (json_equal(ca, cb)) {
+                best = cb;
+                bi = i;
+                break;
+            }
+            if (ka[0] && !best) {
+                best = cb;
+                bi = i;
+            }
+        }
+        if (!best) {
+            diffs += json_report(fp, "removed", path, ca, NULL);
+            continue;
+        }
+        matched[bi] = true;
+        if (ka[0]) {
+            snprintf(path + len, plen - len, "[%s]", ka);
+            diffs += json_diff_path(fp, path, plen, ca, best);
+            path[len] = 0;
+        }
+    }
+    for (i = 0, cb = b->child; cb; cb = cb->next, i++) {
+        if (!matched[i])
+            diffs += json_report(fp, "added", path, NULL, cb);
+    }
+    free(matched);
+    return diffs;
+}
+
+int json_diff(FILE *fp, struct json_node *a, struct json_node *b)
+{
+    char path[1024] = "";
+
+    return json_diff_path(fp, path, sizeof(path), a, b);
+}
@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* writer */
+void json_start(FILE *fp);
+void json_finish(void);
+void json_object_start(const char *key);
+void json_object_end(void);
+void json_array_start(const char *key);
+void json_array_end(void);
+void json_string(const char *key, const char *value);
+void json_int(const char *key, int64_t value);
+void json_uint(const char *key, uint64_t value);
+void json_bool(const char *key, bool value);
+void json_hex(const char *key, const void *data, size_t len);
+
+/* parser */
+enum json_type {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+};
+
+struct json_node {
+    enum json_type   type;
+    char             *key;      /* object members only            */
+    char             *value;    /* string, number (as text), bool */
+    struct json_node *child;    /* array, object                  */
+    struct json_node *next;
+};
+
+struct json_node *json_parse_file(const char *filename);
+void json_free(struct json_node *node);
+
+/* compare */
+int json_diff(FILE *fp, struct json_node *a, struct json_node *b);
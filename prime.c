@@ -7,12 +7,17 @@
 #include <inttypes.h>
 #include <getopt.h>
 #include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
 
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <linux/dma-buf.h>
 
 #include <xf86drm.h>
 #include <xf86drmMode.h>
+#include <libdrm/drm_fourcc.h>
 
 #include <gbm.h>
 
@@ -23,7 +28,7 @@
 #define TEST_HEIGHT 480
 #define TEST_SIZE   (TEST_WIDTH * TEST_HEIGHT * 4)
 
-#define DEV_COUNT 16
+#define BW_BYTES  (64 * 1024 * 1024)   /* per bandwidth measurement */
 
 struct dev {
     int index, fd;
@@ -33,8 +38,46 @@ struct dev {
     bool import;
     bool export;
     struct gbm_device *gbm;
+    pthread_mutex_t lock;   /* serializes gbm calls */
+    uint64_t *mods;         /* scanout modifiers (IN_FORMATS) */
+    int nmods;
 };
 
+enum {
+    STEP_ALLOC,
+    STEP_EXPORT,
+    STEP_IMPORT,
+    STEP_MAP,
+    STEP_COUNT,
+};
+
+static const char *step_names[STEP_COUNT] = {
+    [ STEP_ALLOC  ] = "allocation",
+    [ STEP_EXPORT ] = "export",
+    [ STEP_IMPORT ] = "import",
+    [ STEP_MAP    ] = "first mmap",
+};
+
+struct pair {
+    struct dev *ex, *im;
+    uint32_t width, height;
+    uint64_t modifier;      /* DRM_FORMAT_MOD_INVALID: implicit */
+    pthread_t thread;
+    bool active;
+    bool fdinfo;            /* measure gem memory (serial only) */
+    int passed;             /* number of steps passed */
+    double time[STEP_COUNT];/* ms, per step */
+    int64_t mem_ex, mem_im; /* kB, gem memory while shared */
+};
+
+static struct dev **devs;
+static int devcnt;
+static struct pair *pairs;
+static uint64_t *mods;      /* modifier candidates, all devices */
+static int nmods;
+
+#define PAIR(_e, _i) (pairs + (_e) * devcnt + (_i))
+
 /* ------------------------------------------------------------------ */
 
 #define INDENT_WIDTH  4
@@ -64,6 +107,69 @@ static void print_test(const char *name, bool failed, int err)
     fprintf(stderr, "\n");
 }
 
+static double prime_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* ------------------------------------------------------------------ */
+
+static int drm_scan_devs(void)
+{
+    struct dirent *ent;
+    int nr, max = -1;
+    DIR *dir;
+
+    dir = opendir(DRM_DIR_NAME);
+    if (!dir)
+        return 0;
+    while ((ent = readdir(dir)) != NULL) {
+        if (sscanf(ent->d_name, "card%d", &nr) == 1 && nr > max)
+            max = nr;
+    }
+    closedir(dir);
+    return max + 1;
+}
+
+/*
+ * Sum up the gem memory the kernel accounts to this drm file, in kB.
+ * Uses the drm-total-<region> keys (linux 6.5+), or the older
+ * drm-memory-<region> keys.  Returns -1 if not supported.
+ */
+static int64_t drm_fdinfo_memory(int fd)
+{
+    char path[64], line[256], unit[16];
+    int64_t total = -1, legacy = -1, value;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", fd);
+    fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    while (fgets(line, sizeof(line), fp)) {
+        unit[0] = 0;
+        if (!strchr(line, ':') ||
+            sscanf(strchr(line, ':') + 1, "%" SCNd64 " %15s",
+                   &value, unit) < 1)
+            continue;
+        if (strcmp(unit, "MiB") == 0)
+            value *= 1024;
+        else if (strcmp(unit, "GiB") == 0)
+            value *= 1024 * 1024;
+        else if (strcmp(unit, "KiB") != 0)
+            value /= 1024;
+        if (strncmp(line, "drm-total-", 10) == 0)
+            total = (total < 0 ? 0 : total) + value;
+        else if (strncmp(line, "drm-memory-", 11) == 0)
+            legacy = (legacy < 0 ? 0 : legacy) + value;
+    }
+    fclose(fp);
+    return total >= 0 ? total : legacy;
+}
+
 /* ------------------------------------------------------------------ */
 
 static struct dev *drm_init_dev(int card)
@@ -74,6 +180,7 @@ static struct dev *drm_init_dev(int card)
     dev = malloc(sizeof(*dev));
     memset(dev, 0, sizeof(*dev));
     dev->index = card;
+    pthread_mutex_init(&dev->lock, NULL);
 
     /* open device */
     snprintf(dev->devname, sizeof(dev->devname),
@@ -106,6 +213,88 @@ static struct dev *drm_init_dev(int card)
     return dev;
 }
 
+static bool mod_list_has(const uint64_t *list, int count, uint64_t mod)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+        if (list[i] == mod)
+            return true;
+    return false;
+}
+
+static void mod_list_add(uint64_t **list, int *count, uint64_t mod)
+{
+    if (mod_list_has(*list, *count, mod))
+        return;
+    *list = realloc(*list, (*count + 1) * sizeof((*list)[0]));
+    (*list)[(*count)++] = mod;
+}
+
+static drmModePropertyBlobRes *drm_plane_in_formats(int fd, uint32_t plane_id)
+{
+    drmModeObjectPropertiesPtr props;
+    drmModePropertyPtr prop;
+    drmModePropertyBlobRes *blob = NULL;
+    int i;
+
+    props = drmModeObjectGetProperties(fd, plane_id, DRM_MODE_OBJECT_PLANE);
+    if (!props)
+        return NULL;
+    for (i = 0; i < props->count_props && !blob; i++) {
+        prop = drmModeGetProperty(fd, props->props[i]);
+        if (!prop)
+            continue;
+        if (strcmp(prop->name, "IN_FORMATS") == 0 && props->prop_values[i])
+            blob = drmModeGetPropertyBlob(fd, props->prop_values[i]);
+        drmModeFreeProperty(prop);
+    }
+    drmModeFreeObjectProperties(props);
+    return blob;
+}
+
+/*
+ * Collect the modifiers the display planes accept for the test
+ * format.  Render-only devices have no planes, for those we ask
+ * gbm later on (see dev_has_modifier).
+ */
+static void drm_scanout_modifiers(struct dev *dev)
+{
+    drmModePlaneResPtr planes;
+    drmModePropertyBlobRes *blob;
+    struct drm_format_modifier_blob *fmb;
+    struct drm_format_modifier *fmods;
+    uint32_t *formats;
+    int p, f, m;
+
+    drmSetClientCap(dev->fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+    planes = drmModeGetPlaneResources(dev->fd);
+    if (!planes)
+        return;
+
+    for (p = 0; p < planes->count_planes; p++) {
+        blob = drm_plane_in_formats(dev->fd, planes->planes[p]);
+        if (!blob)
+            continue;
+        fmb = blob->data;
+        formats = (void*)((char*)fmb + fmb->formats_offset);
+        fmods = (void*)((char*)fmb + fmb->modifiers_offset);
+        for (f = 0; f < fmb->count_formats; f++) {
+            if (formats[f] != DRM_FORMAT_XRGB8888)
+                continue;
+            for (m = 0; m < fmb->count_modifiers; m++) {
+                if (f < fmods[m].offset || f > fmods[m].offset + 63)
+                    continue;
+                if (!(fmods[m].formats & (1ULL << (f - fmods[m].offset))))
+                    continue;
+                mod_list_add(&dev->mods, &dev->nmods, fmods[m].modifier);
+            }
+        }
+        drmModeFreePropertyBlob(blob);
+    }
+    drmModeFreePlaneResources(planes);
+}
+
 static int drm_dumb_buf(int fd)
 {
     struct drm_mode_create_dumb creq = {
@@ -129,7 +318,7 @@ static int drm_export_buf(int fd, int handle)
     int dmabuf;
     int rc;
 
-    rc = drmPrimeHandleToFD(fd, handle, 0, &dmabuf);
+    rc = drmPrimeHandleToFD(fd, handle, DRM_CLOEXEC | DRM_RDWR, &dmabuf);
     print_test("export buffer", rc < 0, errno);
     if (rc < 0) {
         return rc;
@@ -140,14 +329,185 @@ static int drm_export_buf(int fd, int handle)
 
 /* ------------------------------------------------------------------ */
 
-static void dmabuf_mmap(int dmabuf)
+static int dmabuf_sync(int dmabuf, uint64_t flags)
 {
-    void *ptr;
+    struct dma_buf_sync sync = {
+        .flags = flags,
+    };
 
-    ptr = mmap(NULL, TEST_SIZE, PROT_READ, MAP_SHARED, dmabuf, 0);
+    return drmIoctl(dmabuf, DMA_BUF_IOCTL_SYNC, &sync);
+}
+
+/* computed in 32 bits, so fill and check agree on the stored word */
+static uint32_t dmabuf_pattern(size_t i, uint32_t seed)
+{
+    return (uint32_t)(i * 0x9e3779b1u) ^ seed;
+}
+
+static void dmabuf_fill(uint32_t *ptr, size_t size, uint32_t seed)
+{
+    size_t i;
+
+    for (i = 0; i < size / 4; i++)
+        ptr[i] = dmabuf_pattern(i, seed);
+}
+
+static size_t dmabuf_check(const uint32_t *ptr, size_t size, uint32_t seed)
+{
+    size_t i, errors = 0;
+
+    for (i = 0; i < size / 4; i++)
+        if (ptr[i] != dmabuf_pattern(i, seed))
+            errors++;
+    return errors;
+}
+
+static void dmabuf_mmap(int dmabuf, bool write)
+{
+    uint32_t *ptr;
+    size_t errors;
+
+    ptr = mmap(NULL, TEST_SIZE, PROT_READ | (write ? PROT_WRITE : 0),
+               MAP_SHARED, dmabuf, 0);
     print_test("mmap dmabuf", ptr == MAP_FAILED, errno);
-    if (ptr != MAP_FAILED) {
-        munmap(ptr, TEST_SIZE);
+    if (ptr == MAP_FAILED)
+        return;
+
+    if (write) {
+        dmabuf_sync(dmabuf, DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE);
+        dmabuf_fill(ptr, TEST_SIZE, 0x12345678);
+        dmabuf_sync(dmabuf, DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE);
+        dmabuf_sync(dmabuf, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
+        errors = dmabuf_check(ptr, TEST_SIZE, 0x12345678);
+        dmabuf_sync(dmabuf, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+        print_test("verify pattern", errors, 0);
+    }
+    munmap(ptr, TEST_SIZE);
+}
+
+/* ------------------------------------------------------------------ */
+/* cross-device bandwidth                                             */
+
+static const struct {
+    uint32_t width, height;
+} bw_sizes[] = {
+    {   64,   64 },
+    {  256,  256 },
+    {  640,  480 },
+    { 1920, 1080 },
+    { 3840, 2160 },
+};
+
+/*
+ * Map the imported buffer through the importer device.  Not all
+ * drivers support dumb mmap for imported objects, fall back to
+ * mapping the dma-buf directly then.
+ */
+static void *dmabuf_import_map(struct dev *im, int dmabuf, size_t size,
+                               uint32_t *handle, const char **how)
+{
+    struct drm_mode_map_dumb mreq = {};
+    void *ptr;
+
+    *handle = 0;
+    if (drmPrimeFDToHandle(im->fd, dmabuf, handle) < 0)
+        return MAP_FAILED;
+    mreq.handle = *handle;
+    if (drmIoctl(im->fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq) == 0) {
+        ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, im->fd, mreq.offset);
+        if (ptr != MAP_FAILED) {
+            *how = "importer mmap";
+            return ptr;
+        }
+    }
+    *how = "dma-buf mmap";
+    return mmap(NULL, size, PROT_READ, MAP_SHARED, dmabuf, 0);
+}
+
+static void dmabuf_bandwidth(struct dev *ex, struct dev *im)
+{
+    struct drm_mode_create_dumb creq;
+    struct drm_mode_destroy_dumb dreq;
+    struct drm_gem_close gclose;
+    uint32_t *wptr, *rptr, handle;
+    double start, wtime, rtime;
+    size_t errors;
+    const char *how;
+    int dmabuf, i, n, loops;
+
+    fprintf(stderr, "    %s (%d) -> %s (%d)\n",
+            ex->ver->name, ex->index,
+            im->ver->name, im->index);
+
+    for (i = 0; i < sizeof(bw_sizes)/sizeof(bw_sizes[0]); i++) {
+        memset(&creq, 0, sizeof(creq));
+        creq.width  = bw_sizes[i].width;
+        creq.height = bw_sizes[i].height;
+        creq.bpp    = 32;
+        if (drmIoctl(ex->fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
+            print_test("create buffer", true, errno);
+            return;
+        }
+        if (drmPrimeHandleToFD(ex->fd, creq.handle, DRM_CLOEXEC | DRM_RDWR,
+                               &dmabuf) < 0) {
+            print_test("export buffer", true, errno);
+            goto done1;
+        }
+        wptr = mmap(NULL, creq.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    dmabuf, 0);
+        if (wptr == MAP_FAILED) {
+            print_test("mmap dmabuf", true, errno);
+            goto done2;
+        }
+        rptr = dmabuf_import_map(im, dmabuf, creq.size, &handle, &how);
+        if (rptr == MAP_FAILED) {
+            print_test("import buffer", true, errno);
+            goto done3;
+        }
+
+        loops = BW_BYTES / creq.size;
+        if (loops < 1)
+            loops = 1;
+        errors = 0;
+        wtime = rtime = 0;
+        for (n = 0; n < loops; n++) {
+            start = prime_time();
+            dmabuf_sync(dmabuf, DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE);
+            dmabuf_fill(wptr, creq.size, n);
+            dmabuf_sync(dmabuf, DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE);
+            wtime += prime_time() - start;
+
+            start = prime_time();
+            dmabuf_sync(dmabuf, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
+            errors += dmabuf_check(rptr, creq.size, n);
+            dmabuf_sync(dmabuf, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+            rtime += prime_time() - start;
+        }
+
+        fprintf(stderr, "%*s%4dx%-4d %6" PRIu64 " kB: "
+                "write %7.1f MB/s, read+verify %7.1f MB/s (%s)",
+                INDENT_WIDTH * 2, "",
+                creq.width, creq.height, (uint64_t)creq.size / 1024,
+                creq.size * loops / (wtime / 1000) / (1024 * 1024),
+                creq.size * loops / (rtime / 1000) / (1024 * 1024),
+                how);
+        if (errors)
+            fprintf(stderr, ", %zd ERRORS", errors);
+        fprintf(stderr, "\n");
+
+        munmap(rptr, creq.size);
+done3:
+        if (handle && im != ex) {
+            memset(&gclose, 0, sizeof(gclose));
+            gclose.handle = handle;
+            drmIoctl(im->fd, DRM_IOCTL_GEM_CLOSE, &gclose);
+        }
+        munmap(wptr, creq.size);
+done2:
+        close(dmabuf);
+done1:
+        dreq.handle = creq.handle;
+        drmIoctl(ex->fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
     }
 }
 
@@ -181,55 +541,366 @@ static void gbm_test(struct gbm_device *gbm, bool export)
     if (dmabuf < 0)
         goto done_bo;
 
-    dmabuf_mmap(dmabuf);
+    /* gbm exports read-only dma-bufs */
+    dmabuf_mmap(dmabuf, false);
     close(dmabuf);
 
 done_bo:
     gbm_bo_destroy(bo);
 }
 
-static void gbm_export_import(struct dev *ex,
-                              struct dev *im)
+static void *gbm_export_import(void *arg)
 {
+    struct pair *p = arg;
     struct gbm_bo *bo_ex, *bo_im;
     struct gbm_import_fd_data import;
-    bool failed = true;
-    int dmabuf;
+    struct gbm_import_fd_modifier_data import_mod;
+    int64_t mem_ex = 0, mem_im = 0;
+    int dmabuf = -1, plane;
+    double start;
+    size_t size;
+    void *ptr;
 
-    fprintf(stderr, "    %s (%d) -> %s (%d)\n",
-            ex->ver->name, ex->index,
-            im->ver->name, im->index);
+    if (p->fdinfo) {
+        mem_ex = drm_fdinfo_memory(p->ex->fd);
+        mem_im = drm_fdinfo_memory(p->im->fd);
+    }
 
-    bo_ex = gbm_bo_create(ex->gbm, TEST_WIDTH, TEST_HEIGHT,
-                          GBM_FORMAT_XRGB8888,
-                          0);
+    /* allocate */
+    pthread_mutex_lock(&p->ex->lock);
+    start = prime_time();
+    if (p->modifier == DRM_FORMAT_MOD_INVALID) {
+        bo_ex = gbm_bo_create(p->ex->gbm, p->width, p->height,
+                              GBM_FORMAT_XRGB8888,
+                              0);
+    } else {
+        bo_ex = gbm_bo_create_with_modifiers(p->ex->gbm, p->width, p->height,
+                                             GBM_FORMAT_XRGB8888,
+                                             &p->modifier, 1);
+        if (bo_ex && gbm_bo_get_modifier(bo_ex) != p->modifier) {
+            gbm_bo_destroy(bo_ex);
+            bo_ex = NULL;
+        }
+    }
+    p->time[STEP_ALLOC] = prime_time() - start;
+    pthread_mutex_unlock(&p->ex->lock);
     if (!bo_ex)
-        return;
+        return NULL;
+    p->passed++;
 
+    /* export */
+    pthread_mutex_lock(&p->ex->lock);
+    start = prime_time();
     dmabuf = gbm_bo_get_fd(bo_ex);
+    p->time[STEP_EXPORT] = prime_time() - start;
+    pthread_mutex_unlock(&p->ex->lock);
     if (dmabuf < 0)
         goto done1;
+    p->passed++;
 
-    import.fd = dmabuf;
-    import.width = TEST_WIDTH;
-    import.height = TEST_HEIGHT;
-    import.stride = TEST_WIDTH * 4;
-    import.format = GBM_FORMAT_XRGB8888;
-    bo_im = gbm_bo_import(im->gbm, GBM_BO_IMPORT_FD, &import, 0);
+    /* import */
+    if (p->modifier == DRM_FORMAT_MOD_INVALID) {
+        import.fd = dmabuf;
+        import.width = p->width;
+        import.height = p->height;
+        import.stride = gbm_bo_get_stride(bo_ex);
+        import.format = GBM_FORMAT_XRGB8888;
+    } else {
+        /* all planes live in the same dma-buf */
+        memset(&import_mod, 0, sizeof(import_mod));
+        import_mod.width = p->width;
+        import_mod.height = p->height;
+        import_mod.format = GBM_FORMAT_XRGB8888;
+        import_mod.modifier = p->modifier;
+        import_mod.num_fds = gbm_bo_get_plane_count(bo_ex);
+        for (plane = 0; plane < import_mod.num_fds; plane++) {
+            import_mod.fds[plane] = dmabuf;
+            import_mod.strides[plane] = gbm_bo_get_stride_for_plane(bo_ex, plane);
+            import_mod.offsets[plane] = gbm_bo_get_offset(bo_ex, plane);
+        }
+    }
+    pthread_mutex_lock(&p->im->lock);
+    start = prime_time();
+    if (p->modifier == DRM_FORMAT_MOD_INVALID)
+        bo_im = gbm_bo_import(p->im->gbm, GBM_BO_IMPORT_FD, &import, 0);
+    else
+        bo_im = gbm_bo_import(p->im->gbm, GBM_BO_IMPORT_FD_MODIFIER,
+                              &import_mod, 0);
+    p->time[STEP_IMPORT] = prime_time() - start;
+    pthread_mutex_unlock(&p->im->lock);
     if (!bo_im)
         goto done2;
+    p->passed++;
 
-    /* passed */
-    failed = false;
+    /* first cpu access */
+    size = (size_t)gbm_bo_get_stride(bo_ex) * p->height;
+    start = prime_time();
+    ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, dmabuf, 0);
+    if (ptr != MAP_FAILED) {
+        (void)*(volatile uint32_t*)ptr;
+        munmap(ptr, size);
+        p->passed++;
+    }
+    p->time[STEP_MAP] = prime_time() - start;
+
+    if (p->fdinfo) {
+        p->mem_ex = mem_ex < 0 ? -1 : drm_fdinfo_memory(p->ex->fd) - mem_ex;
+        p->mem_im = mem_im < 0 ? -1 : drm_fdinfo_memory(p->im->fd) - mem_im;
+    }
 
     /* cleanup */
+    pthread_mutex_lock(&p->im->lock);
     gbm_bo_destroy(bo_im);
+    pthread_mutex_unlock(&p->im->lock);
 done2:
     close(dmabuf);
 done1:
+    pthread_mutex_lock(&p->ex->lock);
     gbm_bo_destroy(bo_ex);
+    pthread_mutex_unlock(&p->ex->lock);
+    return NULL;
+}
+
+static bool prime_pair_ok(int e, int i)
+{
+    return devs[e] && devs[e]->gbm && devs[e]->export &&
+        devs[i] && devs[i]->gbm && devs[i]->import;
+}
+
+static void prime_matrix_run(bool serial)
+{
+    struct pair *p;
+    int e, i, rc;
+
+    for (e = 0; e < devcnt; e++) {
+        for (i = 0; i < devcnt; i++) {
+            if (!prime_pair_ok(e, i))
+                continue;
+            p = PAIR(e, i);
+            p->ex = devs[e];
+            p->im = devs[i];
+            p->width = TEST_WIDTH;
+            p->height = TEST_HEIGHT;
+            p->modifier = DRM_FORMAT_MOD_INVALID;
+            p->active = true;
+            if (serial) {
+                gbm_export_import(p);
+            } else {
+                rc = pthread_create(&p->thread, NULL, gbm_export_import, p);
+                if (rc != 0) {
+                    fprintf(stderr, "pthread_create: %s\n", strerror(rc));
+                    exit(1);
+                }
+            }
+        }
+    }
+
+    for (e = 0; e < devcnt; e++) {
+        for (i = 0; i < devcnt; i++) {
+            p = PAIR(e, i);
+            if (!p->active)
+                continue;
+            if (!serial)
+                pthread_join(p->thread, NULL);
+            fprintf(stderr, "    %s (%d) -> %s (%d)\n",
+                    p->ex->ver->name, p->ex->index,
+                    p->im->ver->name, p->im->index);
+            print_test("transfer dmabuf", p->passed < STEP_COUNT, 0);
+        }
+    }
+}
+
+static void prime_matrix_print(int step)
+{
+    char name[32];
+    struct pair *p;
+    int e, i;
+
+    fprintf(stderr, "\n%s latency, ms (rows: exporter, columns: importer)\n",
+            step_names[step]);
+    fprintf(stderr, "%*s%-*s", INDENT_WIDTH, "", NAME_WIDTH, "");
+    for (i = 0; i < devcnt; i++) {
+        if (!devs[i])
+            continue;
+        snprintf(name, sizeof(name), "%s (%d)",
+                 devs[i]->ver->name, devs[i]->index);
+        fprintf(stderr, " %12s", name);
+    }
+    fprintf(stderr, "\n");
+
+    for (e = 0; e < devcnt; e++) {
+        if (!devs[e])
+            continue;
+        snprintf(name, sizeof(name), "%s (%d)",
+                 devs[e]->ver->name, devs[e]->index);
+        fprintf(stderr, "%*s%-*s", INDENT_WIDTH, "", NAME_WIDTH, name);
+        for (i = 0; i < devcnt; i++) {
+            if (!devs[i])
+                continue;
+            p = PAIR(e, i);
+            if (!p->active || p->passed < step)
+                fprintf(stderr, " %12s", "-");
+            else if (p->passed == step)
+                fprintf(stderr, " %12s", "FAILED");
+            else
+                fprintf(stderr, " %12.3f", p->time[step]);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* modifier negotiation                                               */
+
+static const struct {
+    uint64_t mod;
+    const char *name;
+} drm_fmt_mod_name[] = {
+#include "drmfmtmods.h"
+};
+
+static const char *prime_modifier_string(uint64_t mod)
+{
+    int i;
+
+    for (i = 0; i < sizeof(drm_fmt_mod_name)/sizeof(drm_fmt_mod_name[0]); i++)
+        if (drm_fmt_mod_name[i].mod == mod)
+            return drm_fmt_mod_name[i].name;
+    return NULL;
+}
+
+static bool dev_has_modifier(struct dev *dev, uint64_t mod)
+{
+    int planes;
 
-    print_test("transfer dmabuf", failed, 0);
+    if (mod_list_has(dev->mods, dev->nmods, mod))
+        return true;
+    pthread_mutex_lock(&dev->lock);
+    planes = gbm_device_get_format_modifier_plane_count(dev->gbm,
+                                                        GBM_FORMAT_XRGB8888,
+                                                        mod);
+    pthread_mutex_unlock(&dev->lock);
+    return planes > 0;
+}
+
+static void prime_modifiers(int e, int i)
+{
+    struct pair pair, *p = &pair;
+    const char *name;
+    char hex[24];
+    int m, shared = 0, works = 0;
+
+    fprintf(stderr, "    %s (%d) -> %s (%d)\n",
+            devs[e]->ver->name, devs[e]->index,
+            devs[i]->ver->name, devs[i]->index);
+    for (m = 0; m < nmods; m++) {
+        if (!dev_has_modifier(devs[e], mods[m]) ||
+            !dev_has_modifier(devs[i], mods[m]))
+            continue;
+        shared++;
+
+        memset(p, 0, sizeof(*p));
+        p->ex = devs[e];
+        p->im = devs[i];
+        p->width = TEST_WIDTH;
+        p->height = TEST_HEIGHT;
+        p->modifier = mods[m];
+        gbm_export_import(p);
+        if (p->passed > STEP_IMPORT)
+            works++;
+
+        name = prime_modifier_string(mods[m]);
+        if (!name) {
+            snprintf(hex, sizeof(hex), "0x%016" PRIx64, mods[m]);
+            name = hex;
+        }
+        fprintf(stderr, "%*s%-40s: ", INDENT_WIDTH * 2, "", name);
+        if (p->passed > STEP_IMPORT)
+            fprintf(stderr, "OK (import %.3f ms)\n", p->time[STEP_IMPORT]);
+        else
+            fprintf(stderr, "FAILED (%s)\n", step_names[p->passed]);
+    }
+    fprintf(stderr, "%*s%d shared, %d working\n",
+            INDENT_WIDTH * 2, "", shared, works);
+}
+
+/* ------------------------------------------------------------------ */
+/* buffer size sweep                                                  */
+
+static const struct {
+    uint32_t width, height;
+} sweep_sizes[] = {
+    {   64,   64 },    /* cursor */
+    {  640,  480 },
+    { 1920, 1080 },
+    { 2560, 1440 },
+    { 3840, 2160 },
+    { 7680, 4320 },
+};
+
+static void prime_print_mem(int64_t kb)
+{
+    if (kb < 0)
+        fprintf(stderr, " %10s", "-");
+    else
+        fprintf(stderr, " %7" PRId64 " kB", kb);
+}
+
+static void prime_sweep(int e, int i)
+{
+    struct pair pair, *p = &pair;
+    char size[16];
+    int s, step;
+
+    fprintf(stderr, "    %s (%d) -> %s (%d)\n",
+            devs[e]->ver->name, devs[e]->index,
+            devs[i]->ver->name, devs[i]->index);
+    fprintf(stderr, "%*s%-10s %9s %9s %9s %9s %10s %10s\n",
+            INDENT_WIDTH * 2, "", "size",
+            "alloc", "export", "import", "mmap",
+            "ex mem", "im mem");
+
+    for (s = 0; s < sizeof(sweep_sizes)/sizeof(sweep_sizes[0]); s++) {
+        memset(p, 0, sizeof(*p));
+        p->ex = devs[e];
+        p->im = devs[i];
+        p->width = sweep_sizes[s].width;
+        p->height = sweep_sizes[s].height;
+        p->modifier = DRM_FORMAT_MOD_INVALID;
+        p->fdinfo = true;
+        gbm_export_import(p);
+
+        snprintf(size, sizeof(size), "%dx%d", p->width, p->height);
+        fprintf(stderr, "%*s%-10s", INDENT_WIDTH * 2, "", size);
+        for (step = 0; step < STEP_COUNT; step++) {
+            if (p->passed > step)
+                fprintf(stderr, " %6.3f ms", p->time[step]);
+            else if (p->passed == step)
+                fprintf(stderr, " %9s", "FAILED");
+            else
+                fprintf(stderr, " %9s", "-");
+        }
+        if (p->passed >= STEP_MAP) {
+            prime_print_mem(p->mem_ex);
+            prime_print_mem(p->im == p->ex ? 0 : p->mem_im);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+static void prime_print_fdinfo(void)
+{
+    int i;
+
+    fprintf(stderr, "\ngem memory (/proc/self/fdinfo)\n");
+    for (i = 0; i < devcnt; i++) {
+        if (!devs[i])
+            continue;
+        fprintf(stderr, "%*s%-*s:", INDENT_WIDTH, "",
+                NAME_WIDTH, devs[i]->ver->name);
+        prime_print_mem(drm_fdinfo_memory(devs[i]->fd));
+        fprintf(stderr, "\n");
+    }
 }
 
 /* ------------------------------------------------------------------ */
@@ -243,6 +914,11 @@ static void usage(FILE *fp)
             "options:\n"
             "  -h | --help        print this\n"
             "  -l | --list-cards  list cards\n"
+            "  -b | --bandwidth   measure cross-device dma-buf bandwidth\n"
+            "  -S | --sweep       buffer size sweep (64x64 ... 7680x4320),\n"
+            "                     with gem memory from /proc/self/fdinfo\n"
+            "  -s | --serial      run dma-buf transfer tests one by one\n"
+            "                     (default: all device pairs in parallel)\n"
             "\n");
 }
 
@@ -260,6 +936,18 @@ static struct option long_opts[] = {
         .name    = "list-cards",
         .has_arg = false,
         .val     = 'l',
+    },{
+        .name    = "bandwidth",
+        .has_arg = false,
+        .val     = 'b',
+    },{
+        .name    = "sweep",
+        .has_arg = false,
+        .val     = 'S',
+    },{
+        .name    = "serial",
+        .has_arg = false,
+        .val     = 's',
     },{
         .name    = "complete-bash",
         .has_arg = false,
@@ -271,18 +959,29 @@ static struct option long_opts[] = {
 
 int main(int argc, char **argv)
 {
-    struct dev *devs[DEV_COUNT] = {};
-    int handle, dmabuf, c, i, e;
+    int handle, dmabuf, c, i, e, m, step;
     bool list = false;
+    bool serial = false;
+    bool bandwidth = false;
+    bool sweep = false;
 
     for (;;) {
-        c = getopt_long(argc, argv, "hl", long_opts, NULL);
+        c = getopt_long(argc, argv, "hlbSs", long_opts, NULL);
         if (c == -1)
             break;
         switch (c) {
         case 'l':
             list = true;
             break;
+        case 'b':
+            bandwidth = true;
+            break;
+        case 'S':
+            sweep = true;
+            break;
+        case 's':
+            serial = true;
+            break;
         case OPT_LONG_COMP_BASH:
             complete_bash("prime", long_opts);
             exit(0);
@@ -297,10 +996,14 @@ int main(int argc, char **argv)
 
     logind_init();
 
-    for (i = 0; i < DEV_COUNT; i++) {
+    mod_list_add(&mods, &nmods, DRM_FORMAT_MOD_LINEAR);
+    devcnt = drm_scan_devs();
+    devs = calloc(devcnt + 1, sizeof(devs[0]));
+    pairs = calloc(devcnt * devcnt + 1, sizeof(pairs[0]));
+    for (i = 0; i < devcnt; i++) {
         devs[i] = drm_init_dev(i);
         if (!devs[i])
-            break;
+            continue;
         if (list) {
             close(devs[i]->fd);
             continue;
@@ -311,7 +1014,7 @@ int main(int argc, char **argv)
         if (handle >= 0 && devs[i]->export) {
             dmabuf = drm_export_buf(devs[i]->fd, handle);
             if (dmabuf >= 0) {
-                dmabuf_mmap(dmabuf);
+                dmabuf_mmap(dmabuf, true);
                 close(dmabuf);
             }
         }
@@ -321,26 +1024,49 @@ int main(int argc, char **argv)
         if (devs[i]->gbm)
             gbm_test(devs[i]->gbm, devs[i]->export);
 
+        drm_scanout_modifiers(devs[i]);
+        for (m = 0; m < devs[i]->nmods; m++)
+            mod_list_add(&mods, &nmods, devs[i]->mods[m]);
+
         fprintf(stderr, "\n");
     }
 
     if (!list) {
         fprintf(stderr, "dma-buf transfer tests\n");
-        for (e = 0; e < DEV_COUNT; e++) {
-            if (!devs[e] ||
-                !devs[e]->gbm ||
-                !devs[e]->export)
-                continue;
-            for (i = 0; i < DEV_COUNT; i++) {
-                if (!devs[i] ||
-                    !devs[i]->gbm ||
-                    !devs[i]->import)
+        prime_matrix_run(serial);
+        for (step = 0; step < STEP_COUNT; step++)
+            prime_matrix_print(step);
+
+        fprintf(stderr, "\nmodifier negotiation (xrgb8888, %dx%d)\n",
+                TEST_WIDTH, TEST_HEIGHT);
+        for (e = 0; e < devcnt; e++)
+            for (i = 0; i < devcnt; i++)
+                if (prime_pair_ok(e, i))
+                    prime_modifiers(e, i);
+    }
+
+    if (!list && bandwidth) {
+        fprintf(stderr, "\ndma-buf bandwidth tests\n");
+        for (e = 0; e < devcnt; e++) {
+            if (!devs[e] || !devs[e]->export)
                 continue;
-                gbm_export_import(devs[e], devs[i]);
+            for (i = 0; i < devcnt; i++) {
+                if (!devs[i] || !devs[i]->import)
+                    continue;
+                dmabuf_bandwidth(devs[e], devs[i]);
             }
         }
     }
 
+    if (!list && sweep) {
+        fprintf(stderr, "\nbuffer size sweep\n");
+        for (e = 0; e < devcnt; e++)
+            for (i = 0; i < devcnt; i++)
+                if (prime_pair_ok(e, i))
+                    prime_sweep(e, i);
+        prime_print_fdinfo();
+    }
+
     logind_fini();
     return 0;
 }
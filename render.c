@@ -1,17 +1,150 @@
 #include <stdio.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
 #include <cairo.h>
 
 #include "render.h"
 
 static int pad = 15;
 
+/* ------------------------------------------------------------------ */
+/* text cache                                                         */
+
+/*
+ * Label lines are rasterized once per (text, font size) into an alpha
+ * mask, later frames just composite the mask with the current source.
+ * The font face is looked up once too.  Small LRU, lines which change
+ * every frame (counters) simply replace the least recently used entry.
+ */
+
+#define TEXT_CACHE_SIZE  32
+#define TEXT_CACHE_LEN   64
+
+struct text_entry {
+    char             text[TEXT_CACHE_LEN];
+    double           size;
+    cairo_surface_t  *mask;
+    int              dx, dy;    /* mask position relative to the origin */
+    unsigned int     used;
+};
+
+static bool text_cache = true;
+static struct text_entry text_entries[TEXT_CACHE_SIZE];
+static unsigned int text_clock;
+static cairo_font_face_t *text_face;
+
+void render_set_text_cache(bool enable)
+{
+    int i;
+
+    text_cache = enable;
+    for (i = 0; i < TEXT_CACHE_SIZE; i++) {
+        if (text_entries[i].mask)
+            cairo_surface_destroy(text_entries[i].mask);
+    }
+    memset(text_entries, 0, sizeof(text_entries));
+}
+
+static void render_set_font(cairo_t *cr, double size)
+{
+    if (text_cache) {
+        if (!text_face)
+            text_face = cairo_toy_font_face_create("Liberation Mono",
+                                                   CAIRO_FONT_SLANT_NORMAL,
+                                                   CAIRO_FONT_WEIGHT_NORMAL);
+        cairo_set_font_face(cr, text_face);
+    } else {
+        cairo_select_font_face(cr, "Liberation Mono",
+                               CAIRO_FONT_SLANT_NORMAL,
+                               CAIRO_FONT_WEIGHT_NORMAL);
+    }
+    cairo_set_font_size(cr, size);
+}
+
+static struct text_entry *render_text_lookup(cairo_t *cr, const char *text,
+                                             double size)
+{
+    struct text_entry *e, *lru = text_entries;
+    cairo_text_extents_t te;
+    cairo_t *mcr;
+    int i;
+
+    for (i = 0; i < TEXT_CACHE_SIZE; i++) {
+        e = text_entries + i;
+        if (e->mask && e->size == size && strcmp(e->text, text) == 0) {
+            e->used = ++text_clock;
+            return e;
+        }
+        if (lru->used > e->used)
+            lru = e;
+    }
+
+    /* miss: rasterize into the least recently used entry */
+    e = lru;
+    if (e->mask)
+        cairo_surface_destroy(e->mask);
+    cairo_text_extents(cr, text, &te);
+    e->dx = floor(te.x_bearing) - 1;
+    e->dy = floor(te.y_bearing) - 1;
+    e->mask = cairo_image_surface_create(CAIRO_FORMAT_A8,
+                                         ceil(te.width) + 3,
+                                         ceil(te.height) + 3);
+    mcr = cairo_create(e->mask);
+    render_set_font(mcr, size);
+    cairo_move_to(mcr, -e->dx, -e->dy);
+    cairo_show_text(mcr, text);
+    cairo_destroy(mcr);
+    snprintf(e->text, sizeof(e->text), "%s", text);
+    e->size = size;
+    e->used = ++text_clock;
+    return e;
+}
+
+/*
+ * Masks are rasterized in device pixels at the plain font size, so they
+ * only match when user space maps 1:1 onto whole device pixels.
+ */
+static bool render_text_cacheable(cairo_t *cr)
+{
+    cairo_matrix_t m;
+    double sx, sy;
+
+    cairo_get_matrix(cr, &m);
+    cairo_surface_get_device_scale(cairo_get_target(cr), &sx, &sy);
+    return m.xx == 1 && m.yy == 1 && m.xy == 0 && m.yx == 0 &&
+        m.x0 == round(m.x0) && m.y0 == round(m.y0) &&
+        sx == 1 && sy == 1;
+}
+
+/* font must be set on cr already */
+static void render_text(cairo_t *cr, double x, double y,
+                        const char *text, double size)
+{
+    struct text_entry *e;
+
+    if (!text_cache || strlen(text) >= TEXT_CACHE_LEN ||
+        !render_text_cacheable(cr)) {
+        cairo_move_to(cr, x, y);
+        cairo_show_text(cr, text);
+        return;
+    }
+
+    /* the image backend puts glyphs on whole pixels too */
+    e = render_text_lookup(cr, text, size);
+    cairo_mask_surface(cr, e->mask, round(x) + e->dx, round(y) + e->dy);
+}
+
+/* ------------------------------------------------------------------ */
+
 static void render_color_bar(cairo_t *cr, int x, int y, int w, int h,
                              double r, double g, double b,
                              const char *l1, const char *l2, const char *l3)
 {
     cairo_font_extents_t ext;
     cairo_pattern_t *gr;
+    double size;
     int lines;
 
     gr = cairo_pattern_create_linear(x, y+h/2, w, y+h/2);
@@ -23,9 +156,6 @@ static void render_color_bar(cairo_t *cr, int x, int y, int w, int h,
     cairo_pattern_destroy(gr);
 
     cairo_set_source_rgb(cr, r, g, b);
-    cairo_select_font_face(cr, "Liberation Mono",
-                           CAIRO_FONT_SLANT_NORMAL,
-                           CAIRO_FONT_WEIGHT_NORMAL);
 
     lines = 1;
     if (l2) {
@@ -35,16 +165,15 @@ static void render_color_bar(cairo_t *cr, int x, int y, int w, int h,
             lines++;
     }
 
-    cairo_set_font_size(cr, (h - 2*pad) / lines);
+    size = (h - 2*pad) / lines;
+    render_set_font(cr, size);
     cairo_font_extents(cr, &ext);
-    cairo_move_to(cr, x + pad, y + pad + ext.ascent);
-    cairo_show_text(cr, l1);
+    render_text(cr, x + pad, y + pad + ext.ascent, l1, size);
     if (l2) {
-        cairo_move_to(cr, x + pad, y + pad + ext.ascent + ext.height);
-        cairo_show_text(cr, l2);
+        render_text(cr, x + pad, y + pad + ext.ascent + ext.height, l2, size);
         if (l3) {
-            cairo_move_to(cr, x + pad, y + pad + ext.ascent + ext.height * 2);
-            cairo_show_text(cr, l3);
+            render_text(cr, x + pad, y + pad + ext.ascent + ext.height * 2,
+                        l3, size);
         }
     }
 }
@@ -109,8 +238,16 @@ void render_image(cairo_t *cr, int width, int height, cairo_surface_t *image)
         dy = (height - ys * ih) / 2;
     }
 
-    cairo_translate(cr, dx, dy);
-    cairo_scale(cr, xs, ys);
+    if ((int)(xs * iw + 0.5) == iw && (int)(ys * ih + 0.5) == ih) {
+        /*
+         * pre-scaled by load_image(): put it on whole pixels, so this
+         * is a plain copy without filtering on every redraw
+         */
+        cairo_translate(cr, round(dx), round(dy));
+    } else {
+        cairo_translate(cr, dx, dy);
+        cairo_scale(cr, xs, ys);
+    }
     cairo_set_source_surface(cr, image, 0, 0);
     cairo_rectangle(cr, 0, 0, iw, ih);
     cairo_fill(cr);
@@ -1,3 +1,6 @@
+#include <stdbool.h>
+
+void render_set_text_cache(bool enable);
 void render_test(cairo_t *cr, int width, int height,
                  const char *l1, const char *l2, const char *l3);
 void render_image(cairo_t *cr, int width, int height,
@@ -98,11 +98,19 @@ class BaseDRM(TestDRM):
         virtcaps = self.console_wait('---root---')
         self.write_text(vga, "virtcaps", virtcaps)
 
+        self.console_run('virtiotest --json')
+        virtjson = self.console_wait('---root---')
+        self.write_text(vga, "virtjson", virtjson)
+
         self.console_run('virtiotest -a -s 10')
         self.console_wait('---ok---', '---root---', 'virtiotest')
         self.screen_dump(vga, 'virtio')
         self.console_wait('---root---')
 
+        self.console_run('virtiotest -b')
+        virtbench = self.console_wait('---root---')
+        self.write_text(vga, "virtbench", virtbench)
+
     def virgl_tests(self, vga):
         self.console_run('egltest -i')
         eglinfo = self.console_wait('---root---')
@@ -115,6 +123,22 @@ class BaseDRM(TestDRM):
         self.screen_dump(vga, 'egl')
         self.console_wait('---root---')
 
+        self.console_run('egltest -b')
+        eglbench = self.console_wait('---root---')
+        self.write_text(vga, "eglbench", eglbench)
+
+        self.console_run('egltest -v')
+        eglverify = self.console_wait('---root---')
+        self.write_text(vga, "eglverify", eglverify)
+        if ", 0 mismatch" not in eglverify:
+            self.fail("egl readback verification failed")
+
+        self.console_run('egltest --render 0 -v')
+        eglheadless = self.console_wait('---root---')
+        self.write_text(vga, "eglheadless", eglheadless)
+        if ", 0 mismatch" not in eglheadless:
+            self.fail("egl headless verification failed")
+
     @avocado.skipUnless(os.path.exists('/usr/bin/dracut'), "no dracut")
     @avocado.skipUnless(os.path.exists('/usr/bin/drminfo'), "no drminfo")
     def setUp(self):
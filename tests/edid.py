@@ -33,6 +33,14 @@ class EDID(TestDRM):
         if edid.find("QEMU Monitor") < 0:
             self.fail("edid not valid")
 
+        self.console_run('drminfo -o -e')
+        info = self.console_wait('---root---')
+        self.write_text(vga, "drminfo-edid", info)
+        if info.find('"QEMU Monitor"') < 0:
+            self.fail("drminfo edid decode failed")
+        if info.find("edid mode: ") < 0:
+            self.fail("drminfo found no edid modes")
+
     @avocado.skipUnless(os.path.exists('/usr/bin/dracut'), "no dracut")
     @avocado.skipUnless(os.path.exists('/usr/bin/edid-decode'), "no edid-decode")
     def setUp(self):
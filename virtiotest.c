@@ -9,9 +9,12 @@
 #include <inttypes.h>
 #include <getopt.h>
 #include <assert.h>
+#include <time.h>
+#include <pthread.h>
 
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <linux/virtio_gpu.h>
 #include <libdrm/drm_fourcc.h>
 #include <libdrm/virtgpu_drm.h>
@@ -27,23 +30,69 @@
 #include "ttytools.h"
 #include "render.h"
 #include "complete.h"
+#include "json.h"
 
 /* ------------------------------------------------------------------ */
 
 #define ARRAY_SIZE(_x) (sizeof(_x)/sizeof(_x[0]))
 
+static double virtio_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 /* ------------------------------------------------------------------ */
 
 static struct {
     uint64_t cap;
     const char *name;
+    bool hex;
 } virtio_caps[] = {
-    { .cap = VIRTGPU_PARAM_3D_FEATURES,       .name = "virgl-3d"    },
+    { .cap = VIRTGPU_PARAM_3D_FEATURES,         .name = "virgl-3d"      },
 #ifdef VIRTGPU_PARAM_CAPSET_QUERY_FIX
-    { .cap = VIRTGPU_PARAM_CAPSET_QUERY_FIX,  .name = "capset-fix"  },
+    { .cap = VIRTGPU_PARAM_CAPSET_QUERY_FIX,    .name = "capset-fix"    },
+#endif
+#ifdef VIRTGPU_PARAM_RESOURCE_BLOB
+    { .cap = VIRTGPU_PARAM_RESOURCE_BLOB,       .name = "resource-blob" },
+#endif
+#ifdef VIRTGPU_PARAM_HOST_VISIBLE
+    { .cap = VIRTGPU_PARAM_HOST_VISIBLE,        .name = "host-visible"  },
+#endif
+#ifdef VIRTGPU_PARAM_CROSS_DEVICE
+    { .cap = VIRTGPU_PARAM_CROSS_DEVICE,        .name = "cross-device"  },
+#endif
+#ifdef VIRTGPU_PARAM_CONTEXT_INIT
+    { .cap = VIRTGPU_PARAM_CONTEXT_INIT,        .name = "context-init"  },
+#endif
+#ifdef VIRTGPU_PARAM_SUPPORTED_CAPSET_IDs
+    { .cap = VIRTGPU_PARAM_SUPPORTED_CAPSET_IDs, .name = "capset-ids",
+      .hex = true },
 #endif
 };
 
+
+static const char *virtio_capset_names[] = {
+    [ 1 ] = "virgl",
+    [ 2 ] = "virgl2",
+    [ 3 ] = "gfxstream-vulkan",
+    [ 4 ] = "venus",
+    [ 5 ] = "cross-domain",
+    [ 6 ] = "drm",
+};
+
+#define CAPSET_MAX_SIZE  (64 * 1024)
+#define CAPSET_MAX_FIELDS 4
+
+struct capset_field {
+    const char *name;
+    uint32_t   value;
+};
+
+static char virtio_name[32];   /* virtio bus device, e.g. "virtio1" */
+
 static int virtio_get_cap(uint64_t cap, int *value)
 {
     struct drm_virtgpu_getparam args;
@@ -64,22 +113,257 @@ static int virtio_get_cap(uint64_t cap, int *value)
     return 0;
 }
 
+static uint32_t virtio_capset_mask(void)
+{
+    int value = 0;
+
+#ifdef VIRTGPU_PARAM_SUPPORTED_CAPSET_IDs
+    if (virtio_get_cap(VIRTGPU_PARAM_SUPPORTED_CAPSET_IDs, &value) == 0)
+        return value;
+#endif
+    /* older kernels: virgl only */
+    if (virtio_get_cap(VIRTGPU_PARAM_3D_FEATURES, &value) == 0 && value)
+        return (1 << 1) | (1 << 2);
+    return 0;
+}
+
+/*
+ * Fetch a capset.  The kernel does not report the real size, so
+ * the buffer is zeroed and trailing zeroes are cut off afterwards.
+ */
+static uint8_t *virtio_get_capset(uint32_t id, size_t *size)
+{
+    struct drm_virtgpu_get_caps args;
+    uint8_t *data;
+    size_t len;
+
+    data = malloc(CAPSET_MAX_SIZE);
+    memset(data, 0, CAPSET_MAX_SIZE);
+    memset(&args, 0, sizeof(args));
+    args.cap_set_id = id;
+    args.cap_set_ver = 0;
+    args.addr = (uintptr_t)data;
+    args.size = CAPSET_MAX_SIZE;
+    if (drmIoctl(drm_fd, DRM_IOCTL_VIRTGPU_GET_CAPS, &args) < 0) {
+        free(data);
+        return NULL;
+    }
+
+    len = CAPSET_MAX_SIZE;
+    while (len && !data[len - 1])
+        len--;
+    *size = (len + 3) & ~3;
+    return data;
+}
+
+static int virtio_decode_capset(uint32_t id, const uint8_t *data, size_t size,
+                                struct capset_field *f)
+{
+    const uint32_t *d = (const uint32_t *)data;
+    int count = 0;
+
+    switch (id) {
+    case 1: /* virgl  */
+    case 2: /* virgl2 */
+        f[count].name = "max-version";
+        f[count++].value = d[0];
+        break;
+    case 4: /* venus */
+        f[count].name = "wire-format-version";
+        f[count++].value = d[0];
+        f[count].name = "vk-xml-version";
+        f[count++].value = d[1];
+        break;
+    case 5: /* cross-domain */
+        f[count].name = "version";
+        f[count++].value = d[0];
+        f[count].name = "supported-channels";
+        f[count++].value = d[1];
+        break;
+    case 6: /* drm native context */
+        f[count].name = "wire-format-version";
+        f[count++].value = d[0];
+        f[count].name = "context-type";
+        f[count++].value = d[1];
+        break;
+    }
+    /* don't decode past the end of short capsets */
+    while (count && size < count * sizeof(uint32_t))
+        count--;
+    return count;
+}
+
+static const char *virtio_capset_name(uint32_t id)
+{
+    if (id < ARRAY_SIZE(virtio_capset_names) && virtio_capset_names[id])
+        return virtio_capset_names[id];
+    return "unknown";
+}
+
 static void virtio_print_caps(void)
 {
-    int i, rc, value;
+    struct capset_field fields[CAPSET_MAX_FIELDS];
+    int i, f, rc, value, count;
+    uint32_t mask, id;
+    uint8_t *data;
+    size_t size;
 
     printf("virtio capabilities\n");
     for (i = 0; i < ARRAY_SIZE(virtio_caps); i++) {
         rc = virtio_get_cap(virtio_caps[i].cap, &value);
         if (rc == -1) {
-            printf("    %-12s: not available\n", virtio_caps[i].name);
+            printf("    %-14s: not available\n", virtio_caps[i].name);
+        } else if (virtio_caps[i].hex) {
+            printf("    %-14s: 0x%x\n", virtio_caps[i].name, value);
         } else {
-            printf("    %-12s: %d\n", virtio_caps[i].name, value);
+            printf("    %-14s: %d\n", virtio_caps[i].name, value);
+        }
+    }
+    fprintf(stdout, "\n");
+
+    mask = virtio_capset_mask();
+    if (!mask)
+        return;
+    printf("virtio capsets\n");
+    for (id = 0; id < 32; id++) {
+        if (!(mask & (1 << id)))
+            continue;
+        data = virtio_get_capset(id, &size);
+        if (!data) {
+            printf("    %-2d %-16s: not available\n",
+                   id, virtio_capset_name(id));
+            continue;
         }
+        printf("    %-2d %-16s: %zu bytes", id, virtio_capset_name(id), size);
+        count = virtio_decode_capset(id, data, size, fields);
+        for (f = 0; f < count; f++)
+            printf(", %s %u", fields[f].name, fields[f].value);
+        printf("\n");
+        free(data);
     }
     fprintf(stdout, "\n");
 }
 
+static void virtio_json_caps(FILE *fp, int card)
+{
+    struct capset_field fields[CAPSET_MAX_FIELDS];
+    int i, f, value, count;
+    uint32_t mask, id;
+    uint8_t *data;
+    size_t size;
+
+    json_start(fp);
+    json_object_start(NULL);
+
+    json_object_start("device");
+    json_int("card", card);
+    json_string("virtio", virtio_name);
+    json_string("driver", version->name);
+    json_int("major", version->version_major);
+    json_int("minor", version->version_minor);
+    json_int("patchlevel", version->version_patchlevel);
+    json_object_end();
+
+    json_object_start("params");
+    for (i = 0; i < ARRAY_SIZE(virtio_caps); i++) {
+        if (virtio_get_cap(virtio_caps[i].cap, &value) < 0)
+            continue;
+        json_int(virtio_caps[i].name, value);
+    }
+    json_object_end();
+
+    json_array_start("capsets");
+    mask = virtio_capset_mask();
+    for (id = 0; id < 32; id++) {
+        if (!(mask & (1 << id)))
+            continue;
+        json_object_start(NULL);
+        json_uint("id", id);
+        json_string("name", virtio_capset_name(id));
+        data = virtio_get_capset(id, &size);
+        json_bool("available", data != NULL);
+        if (data) {
+            json_uint("size", size);
+            count = virtio_decode_capset(id, data, size, fields);
+            for (f = 0; f < count; f++)
+                json_uint(fields[f].name, fields[f].value);
+            json_hex("data", data, size);
+            free(data);
+        }
+        json_object_end();
+    }
+    json_array_end();
+
+    json_object_end();
+    json_finish();
+}
+
+/*
+ * The json dump is cached in $XDG_RUNTIME_DIR.  That directory lives
+ * as long as the user's login session, not the boot, so the cache file
+ * is keyed on the kernel boot id plus the device: host side changes
+ * (qemu restarted with other options) always come with a reboot of
+ * the guest and get picked up then.
+ */
+static bool virtio_json_cache_file(char *path, size_t len)
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    char boot_id[64];
+    FILE *fp;
+
+    if (!dir || !virtio_name[0])
+        return false;
+    fp = fopen("/proc/sys/kernel/random/boot_id", "r");
+    if (!fp)
+        return false;
+    if (fscanf(fp, "%63s", boot_id) != 1) {
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+    snprintf(path, len, "%s/drminfo", dir);
+    if (mkdir(path, 0700) < 0 && errno != EEXIST)
+        return false;
+    snprintf(path, len, "%s/drminfo/%s-%s.json", dir, virtio_name, boot_id);
+    return true;
+}
+
+static bool virtio_json_cached(void)
+{
+    char path[256], buf[4096];
+    size_t len;
+    FILE *fp;
+
+    if (!virtio_json_cache_file(path, sizeof(path)))
+        return false;
+    fp = fopen(path, "r");
+    if (!fp)
+        return false;
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+        fwrite(buf, 1, len, stdout);
+    fclose(fp);
+    return true;
+}
+
+static void virtio_json_print(int card)
+{
+    char path[256], tmp[264];
+    FILE *fp;
+
+    if (virtio_json_cache_file(path, sizeof(path))) {
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+        fp = fopen(tmp, "w");
+        if (fp) {
+            virtio_json_caps(fp, card);
+            if (fclose(fp) == 0 && rename(tmp, path) == 0 &&
+                virtio_json_cached())
+                return;
+            unlink(tmp);
+        }
+    }
+    virtio_json_caps(stdout, card);
+}
+
 static void virtio_list_format(void)
 {
     int i;
@@ -110,44 +394,118 @@ static void virtio_check(int cardno)
         fprintf(stderr, "card%d: not a virtio-gpu device\n", cardno);
         exit(1);
     }
+    sscanf(strstr(symlink, "/virtio") + 1, "%31[^/]", virtio_name);
 }
 
 /* ------------------------------------------------------------------ */
 
-static struct drm_virtgpu_resource_create create;
-static uint8_t *fbmem;
+/* virgl resource parameters, see virgl_hw.h */
+#define VIRGL_TARGET_TEXTURE_2D    2
+#define VIRGL_BIND_RENDER_TARGET   (1 << 1)
+
+struct virtio_fb {
+    struct drm_virtgpu_resource_create create;
+    uint8_t          *mem;
+    uint32_t         stride;
+    uint32_t         size;
+    uint32_t         fb_id;
+    bool             blob;
+    cairo_surface_t  *cs;
+
+    /* update loop results */
+    unsigned int     frames;
+    double           elapsed;   /* seconds */
+    double           busy;      /* seconds, transfer + flush */
+};
+
 static const struct fbformat *fmt;
-static cairo_surface_t *cs;
+static struct virtio_fb fb0;
 
-static void virtio_init_fb(void)
+static bool virtio_has_blob(void)
+{
+#ifdef DRM_IOCTL_VIRTGPU_RESOURCE_CREATE_BLOB
+    int value = 0;
+
+    if (virtio_get_cap(VIRTGPU_PARAM_RESOURCE_BLOB, &value) < 0)
+        return false;
+    return value;
+#else
+    /* libdrm headers too old */
+    return false;
+#endif
+}
+
+static void virtio_create_resource(struct virtio_fb *vfb, uint32_t stride)
 {
-    struct drm_virtgpu_resource_info info;
-    struct drm_virtgpu_map map;
-    uint32_t stride, zero = 0;
     int rc;
 
-    /* create framebuffer */
-    memset(&create, 0, sizeof(create));
-    create.format = fmt->virtio;
-    create.width  = drm_mode->hdisplay;
-    create.height = drm_mode->vdisplay;
-
-    create.target = 2;       /* ??? */
-    create.bind = (1 << 1);  /* ??? */
-    create.depth = 1;
-    create.array_size = 1;
-
-    stride = create.width * fmt->bpp / 8;
-    create.size   = stride * create.height;
-    rc = drmIoctl(drm_fd, DRM_IOCTL_VIRTGPU_RESOURCE_CREATE, &create);
+    vfb->create.target = VIRGL_TARGET_TEXTURE_2D;
+    vfb->create.bind = VIRGL_BIND_RENDER_TARGET;
+    vfb->create.depth = 1;
+    vfb->create.array_size = 1;
+    vfb->create.size = stride * vfb->create.height;
+    rc = drmIoctl(drm_fd, DRM_IOCTL_VIRTGPU_RESOURCE_CREATE, &vfb->create);
     if (rc < 0) {
         fprintf(stderr, "DRM_IOCTL_VIRTGPU_RESOURCE_CREATE: %s\n",
                 strerror(errno));
         exit(1);
     }
+}
+
+/*
+ * Guest memory blob: the host accesses the guest pages directly, so
+ * updates need a resource flush only, no transfer.
+ */
+static void virtio_create_blob(struct virtio_fb *vfb, uint32_t stride)
+{
+#ifdef DRM_IOCTL_VIRTGPU_RESOURCE_CREATE_BLOB
+    struct drm_virtgpu_resource_create_blob blob;
+    uint32_t pagesize = getpagesize();
+    int rc;
+
+    memset(&blob, 0, sizeof(blob));
+    blob.blob_mem = VIRTGPU_BLOB_MEM_GUEST;
+    blob.blob_flags = (VIRTGPU_BLOB_FLAG_USE_MAPPABLE |
+                       VIRTGPU_BLOB_FLAG_USE_SHAREABLE);
+    blob.size = (stride * vfb->create.height + pagesize - 1) & ~(pagesize - 1);
+    rc = drmIoctl(drm_fd, DRM_IOCTL_VIRTGPU_RESOURCE_CREATE_BLOB, &blob);
+    if (rc < 0) {
+        fprintf(stderr, "DRM_IOCTL_VIRTGPU_RESOURCE_CREATE_BLOB: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+    vfb->create.bo_handle = blob.bo_handle;
+    vfb->create.res_handle = blob.res_handle;
+    vfb->create.size = blob.size;
+#else
+    /* not reached, virtio_has_blob() returns false */
+    fprintf(stderr, "blob resources not supported by libdrm headers\n");
+    exit(1);
+#endif
+}
+
+static void virtio_init_fb(struct virtio_fb *vfb, uint32_t width,
+                           uint32_t height, bool blob)
+{
+    struct drm_virtgpu_resource_info info;
+    struct drm_virtgpu_map map;
+    uint32_t stride, zero = 0;
+    int rc;
+
+    /* create framebuffer */
+    memset(vfb, 0, sizeof(*vfb));
+    vfb->create.format = fmt->virtio;
+    vfb->create.width  = width;
+    vfb->create.height = height;
+    stride = width * fmt->bpp / 8;
+    vfb->blob = blob;
+    if (blob)
+        virtio_create_blob(vfb, stride);
+    else
+        virtio_create_resource(vfb, stride);
 
     memset(&info, 0, sizeof(info));
-    info.bo_handle = create.bo_handle;
+    info.bo_handle = vfb->create.bo_handle;
     rc = drmIoctl(drm_fd, DRM_IOCTL_VIRTGPU_RESOURCE_INFO, &info);
     if (rc < 0) {
         fprintf(stderr, "DRM_IOCTL_VIRTGPU_RESOURCE_INFO: %s\n",
@@ -156,65 +514,89 @@ static void virtio_init_fb(void)
     }
 
     memset(&map, 0, sizeof(map));
-    map.handle = create.bo_handle;
+    map.handle = vfb->create.bo_handle;
     rc = drmIoctl(drm_fd, DRM_IOCTL_VIRTGPU_MAP, &map);
     if (rc < 0) {
         fprintf(stderr, "DRM_IOCTL_VIRTGPU_MAP: %s\n", strerror(errno));
         exit(1);
     }
 
-    fbmem = mmap(0, info.size, PROT_READ | PROT_WRITE,
-                 MAP_SHARED, drm_fd, map.offset);
-    if (fbmem == MAP_FAILED) {
+    vfb->size = info.size;
+    vfb->mem = mmap(0, vfb->size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, drm_fd, map.offset);
+    if (vfb->mem == MAP_FAILED) {
         fprintf(stderr, "framebuffer mmap: %s\n", strerror(errno));
         exit(1);
     }
 
-    if (info.stride)
+    /* for blobs the union field carries blob_mem, not the stride */
+    if (!blob && info.stride)
         stride = info.stride;
-    rc = drmModeAddFB2(drm_fd, create.width, create.height, fmt->fourcc,
-                       &create.bo_handle, &stride, &zero, &fb_id, 0);
+    vfb->stride = stride;
+    rc = drmModeAddFB2(drm_fd, width, height, fmt->fourcc,
+                       &vfb->create.bo_handle, &stride, &zero,
+                       &vfb->fb_id, 0);
     if (rc < 0) {
         fprintf(stderr, "drmModeAddFB2() failed: %s\n", strerror(errno));
         exit(1);
     }
 
-    cs = cairo_image_surface_create_for_data(fbmem,
-                                             fmt->cairo,
-                                             create.width,
-                                             create.height,
-                                             stride);
+    vfb->cs = cairo_image_surface_create_for_data(vfb->mem,
+                                                  fmt->cairo,
+                                                  width,
+                                                  height,
+                                                  stride);
 }
 
-static void virtio_draw(void)
+static void virtio_fini_fb(struct virtio_fb *vfb)
+{
+    struct drm_gem_close req;
+
+    cairo_surface_destroy(vfb->cs);
+    drmModeRmFB(drm_fd, vfb->fb_id);
+    munmap(vfb->mem, vfb->size);
+    memset(&req, 0, sizeof(req));
+    req.handle = vfb->create.bo_handle;
+    drmIoctl(drm_fd, DRM_IOCTL_GEM_CLOSE, &req);
+}
+
+static void virtio_draw(struct virtio_fb *vfb, const char *output)
 {
     char info1[80], info2[80], info3[80];
     cairo_t *cr;
 
-    snprintf(info1, sizeof(info1), "virtio-gpu");
+    snprintf(info1, sizeof(info1), "virtio-gpu%s%s%s",
+             output ? " " : "", output ? output : "",
+             vfb->blob ? " (blob)" : "");
     snprintf(info2, sizeof(info2), "%dx%d",
-             drm_mode->hdisplay, drm_mode->vdisplay);
+             vfb->create.width, vfb->create.height);
     snprintf(info3, sizeof(info3), "fourcc %c%c%c%c",
              (fmt->fourcc >>  0) & 0xff,
              (fmt->fourcc >>  8) & 0xff,
              (fmt->fourcc >> 16) & 0xff,
              (fmt->fourcc >> 24) & 0xff);
 
-    cr = cairo_create(cs);
-    render_test(cr, drm_mode->hdisplay, drm_mode->vdisplay, info1, info2, info3);
+    cr = cairo_create(vfb->cs);
+    render_test(cr, vfb->create.width, vfb->create.height,
+                info1, info2, info3);
     cairo_destroy(cr);
 }
 
-static void virtio_transfer(void)
+static void virtio_transfer(struct virtio_fb *vfb, uint32_t x, uint32_t y,
+                            uint32_t w, uint32_t h)
 {
     struct drm_virtgpu_3d_transfer_to_host xfer;
     int rc;
 
     memset(&xfer, 0, sizeof(xfer));
-    xfer.bo_handle = create.bo_handle;
-    xfer.box.w = drm_mode->hdisplay;
-    xfer.box.h = drm_mode->vdisplay;
+    xfer.bo_handle = vfb->create.bo_handle;
+    xfer.box.x = x;
+    xfer.box.y = y;
+    xfer.box.w = w;
+    xfer.box.h = h;
     xfer.box.d = 1;
+    xfer.offset = y * vfb->stride + x * fmt->bpp / 8;
+    xfer.stride = vfb->stride;
     rc = drmIoctl(drm_fd, DRM_IOCTL_VIRTGPU_TRANSFER_TO_HOST, &xfer);
     if (rc < 0) {
         fprintf(stderr, "DRM_IOCTL_VIRTGPU_TRANSFER_TO_HOST: %s\n",
@@ -223,6 +605,418 @@ static void virtio_transfer(void)
     }
 }
 
+static void virtio_flush(struct virtio_fb *vfb, drmModeClip *clips, int count)
+{
+    int rc;
+
+    rc = drmModeDirtyFB(drm_fd, vfb->fb_id, clips, count);
+    if (rc < 0 && errno != ENOSYS) {
+        fprintf(stderr, "drmModeDirtyFB: %s\n", strerror(errno));
+        exit(1);
+    }
+}
+
+static void virtio_wait(struct virtio_fb *vfb)
+{
+    struct drm_virtgpu_3d_wait wait;
+    int rc;
+
+    memset(&wait, 0, sizeof(wait));
+    wait.handle = vfb->create.bo_handle;
+    do {
+        rc = drmIoctl(drm_fd, DRM_IOCTL_VIRTGPU_WAIT, &wait);
+    } while (rc < 0 && errno == EBUSY);
+    if (rc < 0) {
+        fprintf(stderr, "DRM_IOCTL_VIRTGPU_WAIT: %s\n", strerror(errno));
+        exit(1);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* update loop: move a box, transfer damaged rectangles only          */
+
+#define BOX_SIZE 64
+
+static void virtio_damage(struct virtio_fb *vfb, drmModeClip *clip,
+                          int x, int y, int w, int h)
+{
+    clip->x1 = x;
+    clip->y1 = y;
+    clip->x2 = x + w;
+    clip->y2 = y + h;
+    if (!vfb->blob)
+        virtio_transfer(vfb, x, y, w, h);
+}
+
+static void virtio_update_loop(struct virtio_fb *vfb, int secs)
+{
+    uint32_t width = vfb->create.width, height = vfb->create.height;
+    int x = 0, y = 0, dx = 4, dy = 4, ox, oy, row;
+    uint32_t stride = vfb->stride;
+    double start, now;
+    drmModeClip clips[2];
+    uint8_t *background;
+    size_t bpp = fmt->bpp / 8;
+    cairo_t *cr;
+
+    if (width <= BOX_SIZE || height <= BOX_SIZE)
+        return;
+    background = malloc(stride * height);
+    memcpy(background, vfb->mem, stride * height);
+
+    start = now = virtio_time();
+    while (now - start < secs) {
+        ox = x;
+        oy = y;
+        if (x + dx < 0 || x + dx + BOX_SIZE > width)
+            dx = -dx;
+        if (y + dy < 0 || y + dy + BOX_SIZE > height)
+            dy = -dy;
+        x += dx;
+        y += dy;
+
+        /* restore old box position, draw the new one */
+        for (row = oy; row < oy + BOX_SIZE; row++)
+            memcpy(vfb->mem + row * stride + ox * bpp,
+                   background + row * stride + ox * bpp,
+                   BOX_SIZE * bpp);
+        cr = cairo_create(vfb->cs);
+        cairo_set_source_rgb(cr, 1, 1, 1);
+        cairo_rectangle(cr, x, y, BOX_SIZE, BOX_SIZE);
+        cairo_fill(cr);
+        cairo_destroy(cr);
+        cairo_surface_flush(vfb->cs);
+
+        now = virtio_time();
+        virtio_damage(vfb, &clips[0], ox, oy, BOX_SIZE, BOX_SIZE);
+        virtio_damage(vfb, &clips[1], x, y, BOX_SIZE, BOX_SIZE);
+        virtio_flush(vfb, clips, 2);
+        vfb->busy += virtio_time() - now;
+        vfb->frames++;
+
+        usleep(16 * 1000);
+        now = virtio_time();
+    }
+    virtio_wait(vfb);
+    vfb->elapsed = now - start;
+    free(background);
+}
+
+static void virtio_update_print(struct virtio_fb *vfb)
+{
+    if (!vfb->frames)
+        return;
+    fprintf(stdout, "update loop: %u frames, %.1f fps, "
+            "%.3f ms per update (2 x %dx%d)\n",
+            vfb->frames, vfb->frames / vfb->elapsed,
+            vfb->busy * 1000 / vfb->frames,
+            BOX_SIZE, BOX_SIZE);
+}
+
+/* ------------------------------------------------------------------ */
+/* transfer benchmark                                                 */
+
+static const struct {
+    const char *name;
+    uint32_t width, height;    /* 0: full frame */
+} bench_rects[] = {
+    { .name = "full frame" },
+    { .name = "256x256", .width = 256, .height = 256 },
+    { .name = "64x64",   .width =  64, .height =  64 },
+    { .name = "16x16",   .width =  16, .height =  16 },
+};
+
+static void virtio_bench(struct virtio_fb *vfb, double secs)
+{
+    uint32_t width = vfb->create.width, height = vfb->create.height;
+    uint32_t x, y, w, h;
+    double start, now;
+    drmModeClip clip;
+    unsigned int count;
+    int i;
+
+    fprintf(stdout, "%s\n", vfb->blob
+            ? "guest blob resource, resource flush only"
+            : "classic resource, transfer to host + resource flush");
+    fprintf(stdout, "    %-12s  %12s  %10s  %10s\n",
+            "update", "updates/s", "MB/s", "us/update");
+    for (i = 0; i < ARRAY_SIZE(bench_rects); i++) {
+        w = bench_rects[i].width  ? bench_rects[i].width  : width;
+        h = bench_rects[i].height ? bench_rects[i].height : height;
+        if (w > width || h > height)
+            continue;
+
+        /* walk the rectangle over the screen */
+        x = y = count = 0;
+        start = virtio_time();
+        do {
+            virtio_damage(vfb, &clip, x, y, w, h);
+            virtio_flush(vfb, &clip, 1);
+            count++;
+            x += w;
+            if (x + w > width) {
+                x = 0;
+                y += h;
+                if (y + h > height)
+                    y = 0;
+            }
+            now = virtio_time();
+        } while (now - start < secs);
+        virtio_wait(vfb);
+        now = virtio_time();
+
+        fprintf(stdout, "    %-12s  %12.1f  %10.1f  %10.1f\n",
+                bench_rects[i].name,
+                count / (now - start),
+                (double)w * h * fmt->bpp / 8 * count / (now - start)
+                / (1024 * 1024),
+                (now - start) * 1e6 / count);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* transfer round trip latency                                        */
+
+#define LAT_SAMPLES 1000
+
+static int cmp_double(const void *a, const void *b)
+{
+    const double *da = a, *db = b;
+
+    if (*da < *db)
+        return -1;
+    return *da > *db;
+}
+
+static double percentile(const double *sorted, int count, int pct)
+{
+    return sorted[(count - 1) * pct / 100];
+}
+
+static void latency_print(const char *name, double *samples, int count)
+{
+    qsort(samples, count, sizeof(samples[0]), cmp_double);
+    fprintf(stdout, "    %-20s  %8.3f  %8.3f  %8.3f  %8.3f  %8.3f\n", name,
+            samples[0] * 1000,
+            percentile(samples, count, 50) * 1000,
+            percentile(samples, count, 90) * 1000,
+            percentile(samples, count, 99) * 1000,
+            samples[count - 1] * 1000);
+}
+
+/*
+ * Submit a transfer, then block in DRM_IOCTL_VIRTGPU_WAIT until the
+ * host has processed it, and separately time the resource flush.
+ * Without virgl the kernel does not fence 2d transfers, the wait
+ * returns right away then and only covers guest side work.
+ */
+static void virtio_latency(struct virtio_fb *vfb, uint32_t w, uint32_t h)
+{
+    double *xfer, *flush, start, now;
+    char name[32];
+    drmModeClip clip;
+    int i;
+
+    xfer = malloc(sizeof(double) * LAT_SAMPLES);
+    flush = malloc(sizeof(double) * LAT_SAMPLES);
+    for (i = 0; i < LAT_SAMPLES; i++) {
+        start = virtio_time();
+        virtio_damage(vfb, &clip, 0, 0, w, h);
+        virtio_wait(vfb);
+        now = virtio_time();
+        xfer[i] = now - start;
+
+        virtio_flush(vfb, &clip, 1);
+        flush[i] = virtio_time() - now;
+    }
+
+    if (!vfb->blob) {
+        snprintf(name, sizeof(name), "%dx%d transfer", w, h);
+        latency_print(name, xfer, LAT_SAMPLES);
+    }
+    snprintf(name, sizeof(name), "%dx%d flush", w, h);
+    latency_print(name, flush, LAT_SAMPLES);
+    free(xfer);
+    free(flush);
+}
+
+static void virtio_latency_run(struct virtio_fb *vfb)
+{
+    int virgl = 0;
+
+    virtio_get_cap(VIRTGPU_PARAM_3D_FEATURES, &virgl);
+    fprintf(stdout, "round trip latency, %d samples%s\n", LAT_SAMPLES,
+            virgl ? "" : " (no virgl, transfers are not fenced)");
+    fprintf(stdout, "    %-20s  %8s  %8s  %8s  %8s  %8s\n", "ms",
+            "min", "p50", "p90", "p99", "max");
+    virtio_latency(vfb, vfb->create.width, vfb->create.height);
+    if (vfb->create.width >= 64 && vfb->create.height >= 64)
+        virtio_latency(vfb, 64, 64);
+}
+
+/* ------------------------------------------------------------------ */
+
+static void virtio_show(struct virtio_fb *vfb, bool blob)
+{
+    virtio_init_fb(vfb, drm_mode->hdisplay, drm_mode->vdisplay, blob);
+    virtio_draw(vfb, NULL);
+    if (!blob) {
+        virtio_transfer(vfb, 0, 0, vfb->create.width, vfb->create.height);
+        virtio_wait(vfb);
+    }
+    fb_id = vfb->fb_id;
+    drm_show_fb();
+}
+
+/* ------------------------------------------------------------------ */
+/* multiple scanouts: one resource per connected output               */
+
+struct virtio_scanout {
+    char               name[64];
+    drmModeConnector   *conn;
+    drmModeCrtc        *saved;
+    uint32_t           crtc_id;
+    struct virtio_fb   fb;
+    pthread_t          thread;
+    int                secs;
+};
+
+static uint32_t virtio_pick_crtc(drmModeRes *res, drmModeConnector *conn,
+                                 uint32_t *used)
+{
+    drmModeEncoder *enc;
+    int e, c;
+
+    for (e = 0; e < conn->count_encoders; e++) {
+        enc = drmModeGetEncoder(drm_fd, conn->encoders[e]);
+        if (!enc)
+            continue;
+        for (c = 0; c < res->count_crtcs; c++) {
+            if (!(enc->possible_crtcs & (1 << c)) || (*used & (1 << c)))
+                continue;
+            *used |= (1 << c);
+            drmModeFreeEncoder(enc);
+            return res->crtcs[c];
+        }
+        drmModeFreeEncoder(enc);
+    }
+    return 0;
+}
+
+static void *virtio_scanout_thread(void *arg)
+{
+    struct virtio_scanout *so = arg;
+
+    virtio_update_loop(&so->fb, so->secs);
+    return NULL;
+}
+
+static void virtio_multi(int secs, bool blob)
+{
+    struct virtio_scanout *scanouts, *so;
+    drmModeConnector *conn;
+    drmModeModeInfo *mode;
+    uint32_t used = 0;
+    drmModeRes *res;
+    char modename[32];
+    int i, count = 0, rc;
+
+    res = drmModeGetResources(drm_fd);
+    if (!res) {
+        fprintf(stderr, "drmModeGetResources() failed\n");
+        exit(1);
+    }
+    scanouts = calloc(res->count_connectors, sizeof(*scanouts));
+
+    for (i = 0; i < res->count_connectors; i++) {
+        conn = drmModeGetConnector(drm_fd, res->connectors[i]);
+        if (!conn)
+            continue;
+        if (conn->connection != DRM_MODE_CONNECTED || !conn->count_modes) {
+            drmModeFreeConnector(conn);
+            continue;
+        }
+        so = scanouts + count;
+        so->conn = conn;
+        so->secs = secs;
+        drm_conn_name(conn, so->name, sizeof(so->name));
+        so->crtc_id = virtio_pick_crtc(res, conn, &used);
+        if (!so->crtc_id) {
+            fprintf(stderr, "%s: no crtc available\n", so->name);
+            drmModeFreeConnector(conn);
+            continue;
+        }
+        count++;
+    }
+
+    /* present all scanouts */
+    for (i = 0; i < count; i++) {
+        so = scanouts + i;
+        mode = &so->conn->modes[0];
+        virtio_init_fb(&so->fb, mode->hdisplay, mode->vdisplay, blob);
+        virtio_draw(&so->fb, so->name);
+        if (!blob) {
+            virtio_transfer(&so->fb, 0, 0, mode->hdisplay, mode->vdisplay);
+            virtio_wait(&so->fb);
+        }
+        so->saved = drmModeGetCrtc(drm_fd, so->crtc_id);
+        rc = drmModeSetCrtc(drm_fd, so->crtc_id, so->fb.fb_id, 0, 0,
+                            &so->conn->connector_id, 1, mode);
+        if (rc < 0) {
+            fprintf(stderr, "%s: drmModeSetCrtc() failed: %s\n",
+                    so->name, strerror(errno));
+            exit(1);
+        }
+    }
+
+    /* update all scanouts concurrently */
+    for (i = 0; i < count; i++) {
+        so = scanouts + i;
+        rc = pthread_create(&so->thread, NULL, virtio_scanout_thread, so);
+        if (rc != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(rc));
+            exit(1);
+        }
+    }
+    for (i = 0; i < count; i++)
+        pthread_join(scanouts[i].thread, NULL);
+
+    fprintf(stdout, "%d scanouts, concurrent update loop (2 x %dx%d)\n",
+            count, BOX_SIZE, BOX_SIZE);
+    fprintf(stdout, "    %-12s  %10s  %8s  %8s  %10s  %10s\n",
+            "output", "mode", "frames", "fps", "ms/update", "MB/s");
+    for (i = 0; i < count; i++) {
+        so = scanouts + i;
+        snprintf(modename, sizeof(modename), "%dx%d",
+                 so->fb.create.width, so->fb.create.height);
+        if (!so->fb.frames) {
+            fprintf(stdout, "    %-12s  %10s  %8s\n", so->name, modename, "-");
+            continue;
+        }
+        fprintf(stdout, "    %-12s  %10s  %8u  %8.1f  %10.3f  %10.1f\n",
+                so->name, modename, so->fb.frames,
+                so->fb.frames / so->fb.elapsed,
+                so->fb.busy * 1000 / so->fb.frames,
+                2.0 * BOX_SIZE * BOX_SIZE * fmt->bpp / 8 * so->fb.frames
+                / so->fb.busy / (1024 * 1024));
+    }
+
+    /* restore */
+    for (i = 0; i < count; i++) {
+        so = scanouts + i;
+        if (so->saved) {
+            drmModeSetCrtc(drm_fd, so->saved->crtc_id, so->saved->buffer_id,
+                           so->saved->x, so->saved->y,
+                           &so->conn->connector_id, 1, &so->saved->mode);
+            drmModeFreeCrtc(so->saved);
+        }
+        virtio_fini_fb(&so->fb);
+        drmModeFreeConnector(so->conn);
+    }
+    free(scanouts);
+    drmModeFreeResources(res);
+}
+
 /* ------------------------------------------------------------------ */
 
 static void usage(FILE *fp)
@@ -235,7 +1029,20 @@ static void usage(FILE *fp)
             "  -h | --help          print this\n"
             "  -a | --autotest      autotest mode\n"
             "  -i | --info          print virtio device info\n"
+            "       --json          print virtio params and capsets as\n"
+            "                       json (cached until reboot)\n"
             "  -l | --list-formats  list formats\n"
+            "  -u | --update        run update loop, transfer damaged\n"
+            "                       rectangles only (for --sleep secs)\n"
+            "  -b | --bench         transfer benchmark, full frame\n"
+            "                       versus small rectangles, blob\n"
+            "                       resources too if supported\n"
+            "  -B | --blob          use a guest memory blob resource\n"
+            "  -L | --latency       transfer and flush round trip\n"
+            "                       latency percentiles\n"
+            "  -m | --multi         all connected outputs, one resource\n"
+            "                       each, update concurrently (for\n"
+            "                       --sleep secs)\n"
             "  -c | --card  <nr>    pick card\n"
             "  -s | --sleep <secs>  set sleep time (default: 60)\n"
             "\n");
@@ -243,6 +1050,7 @@ static void usage(FILE *fp)
 
 enum {
     OPT_LONG_COMP_BASH = 0x100,
+    OPT_LONG_JSON,
 };
 
 static struct option long_opts[] = {
@@ -263,11 +1071,35 @@ static struct option long_opts[] = {
         .name    = "list-formats",
         .has_arg = false,
         .val     = 'l',
+    },{
+        .name    = "update",
+        .has_arg = false,
+        .val     = 'u',
+    },{
+        .name    = "bench",
+        .has_arg = false,
+        .val     = 'b',
+    },{
+        .name    = "blob",
+        .has_arg = false,
+        .val     = 'B',
+    },{
+        .name    = "latency",
+        .has_arg = false,
+        .val     = 'L',
+    },{
+        .name    = "multi",
+        .has_arg = false,
+        .val     = 'm',
     },{
         .name    = "complete-bash",
         .has_arg = false,
         .val     = OPT_LONG_COMP_BASH,
     },{
+        .name    = "json",
+        .has_arg = false,
+        .val     = OPT_LONG_JSON,
+    },{
 
         /* --- with argument --- */
         .name    = "card",
@@ -291,10 +1123,16 @@ int main(int argc, char **argv)
     bool printinfo = false;
     bool listformat = false;
     bool autotest = false;
+    bool update = false;
+    bool bench = false;
+    bool blob = false;
+    bool latency = false;
+    bool json = false;
+    bool multi = false;
     int c, i;
 
     for (;;) {
-        c = getopt_long(argc, argv, "hailc:s:", long_opts, NULL);
+        c = getopt_long(argc, argv, "hailubBLmc:s:", long_opts, NULL);
         if (c == -1)
             break;
         switch (c) {
@@ -313,6 +1151,24 @@ int main(int argc, char **argv)
         case 'l':
             listformat = true;
             break;
+        case 'u':
+            update = true;
+            break;
+        case 'b':
+            bench = true;
+            break;
+        case 'B':
+            blob = true;
+            break;
+        case 'L':
+            latency = true;
+            break;
+        case 'm':
+            multi = true;
+            break;
+        case OPT_LONG_JSON:
+            json = true;
+            break;
         case OPT_LONG_COMP_BASH:
             complete_bash("virtiotest", long_opts);
             exit(0);
@@ -326,6 +1182,8 @@ int main(int argc, char **argv)
     }
 
     virtio_check(card);
+    if (json && virtio_json_cached())
+        exit(0);
 
     for (i = 0; i < fmtcnt; i++) {
         if (fmts[i].cairo == CAIRO_FORMAT_RGB24 &&
@@ -338,6 +1196,10 @@ int main(int argc, char **argv)
     logind_init();
     drm_init_dev(card, output, modename, false, -1);
 
+    if (json) {
+        virtio_json_print(card);
+        goto done;
+    }
     if (printinfo)
         virtio_print_caps();
     if (listformat)
@@ -345,10 +1207,34 @@ int main(int argc, char **argv)
     if (printinfo || listformat)
         goto done;
 
-    virtio_init_fb();
-    virtio_draw();
-    virtio_transfer();
-    drm_show_fb();
+    if (blob && !virtio_has_blob()) {
+        fprintf(stderr, "card%d: no blob resource support\n", card);
+        exit(1);
+    }
+    if (multi) {
+        virtio_multi(secs, blob);
+        goto done;
+    }
+    virtio_show(&fb0, blob);
+
+    if (bench) {
+        virtio_bench(&fb0, 1.0);
+        if (!blob && virtio_has_blob()) {
+            virtio_fini_fb(&fb0);
+            virtio_show(&fb0, true);
+            virtio_bench(&fb0, 1.0);
+        }
+        goto done;
+    }
+    if (latency) {
+        virtio_latency_run(&fb0);
+        goto done;
+    }
+    if (update) {
+        virtio_update_loop(&fb0, secs);
+        virtio_update_print(&fb0);
+        goto done;
+    }
 
     if (autotest)
         fprintf(stdout, "---ok---\n");